@@ -23,6 +23,7 @@ int Render_5(int width, int height, const std::string output)
 	duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
 
 	std::cout << "\nNtRenderScene completed in " << duration.count() << " milliseconds.\n";
+	status |= NtFreeScene(scene);
 
 	if (status)
 		return(NT_FAILURE);
@@ -0,0 +1,40 @@
+#include "NocturneGL.h"
+#include <iostream>
+#include <chrono>
+
+/// <summary>
+/// Renders a keyframed turntable sequence, scene assets are loaded once and frames are rendered on every core
+/// </summary>
+/// <returns></returns>
+int Render_7(int frameCount, const std::string outputPattern)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	int status = 0;
+	NtScene* scene = new NtScene();
+
+	status |= NtLoadSceneJSON("turntable.json", scene);
+	auto stop = std::chrono::high_resolution_clock::now();
+	auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
+	std::cout << "\nNocturne Renderer load scene completed in " << duration.count() << " milliseconds.\n";
+
+	start = std::chrono::high_resolution_clock::now();
+	status |= NtRenderSequence(scene, outputPattern, frameCount, 0, 1, NT_SHADE_PHONG, 0);
+	stop = std::chrono::high_resolution_clock::now();
+	duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
+
+	std::cout << "\nNtRenderSequence completed " << frameCount << " frames in " << duration.count() << " milliseconds.\n";
+	status |= NtFreeScene(scene);
+
+	if (status)
+		return(NT_FAILURE);
+	else
+		return(NT_SUCCESS);
+
+}
+
+int main_7()
+{
+	int status = Render_7(16, "output7_%02d.ppm");
+	std::cout << "\nRender Status: " << (status == NT_SUCCESS ? "Success" : "Failed");
+	return 0;
+}
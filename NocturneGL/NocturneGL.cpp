@@ -1,10 +1,176 @@
 #include <iostream>
 #include <fstream>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#undef near //minwindef.h macros collide with NtCamera fields
+#undef far
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 #include "NocturneGL.h"
 #include <cmath>
 #include <limits>
 #include "externalPlugins/json.hpp"
 #include <math.h>
+#include <random>
+#include <algorithm>
+#include <thread>
+#include <cstring>
+#include <mutex>
+#include <atomic>
+#include <climits>
+#include <list>
+#include <filesystem>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NT_HAS_SSE2 1
+#endif
+
+//Buffers with at least this many 8 byte elements are filled in parallel
+#define NT_PARALLEL_FILL_MIN (1 << 18)
+
+//Set on frame level workers so per-frame passes don't spawn threads of their own
+static thread_local bool ntSerialThread = false;
+static std::mutex ntLogMutex;
+
+//Statements that only exist in statistics builds
+#if NT_RENDER_STATS
+#define NT_STATS(...) __VA_ARGS__
+#else
+#define NT_STATS(...)
+#endif
+
+//Monotonic clock in seconds for stage timing
+static inline double NtStatsSeconds() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//Cost of one NtStatsSeconds call, subtracted from intervals short enough for it to matter such as a single fragment
+static double NtStatsClockSeconds() {
+	static const double clockSeconds = []() {
+		double best = 1;
+		for (int i = 0; i < 64; i++) {
+			double start = NtStatsSeconds();
+			best = std::min(best, NtStatsSeconds() - start);
+		}
+		return best;
+	}();
+	return clockSeconds;
+}
+
+//Scoped trace events, recorded between NtBeginTrace and NtEndTrace and exported in Chrome trace event format
+#if NT_TRACE
+typedef struct NtTraceEvent {
+	const char* name; //String literal
+	char detail[40]; //Optional argument such as a file or shape id, truncated
+	double start; //Microseconds since NtBeginTrace
+	double duration;
+} NtTraceEvent;
+
+//Ring of events written only by the thread that holds it, head is published with release so the exporter sees whole events
+typedef struct NtTraceBuffer {
+	std::vector<NtTraceEvent> events;
+	std::atomic<unsigned long long> head{ 0 };
+	int lane = 0; //Exported thread id, a buffer is reused by later threads once its owner exits
+	int session = -1; //Trace the buffer was handed out in, only the current trace's buffers are exported
+	bool owned = false; //Held by a thread, which may still write to it. Guarded by ntTraceMutex
+} NtTraceBuffer;
+
+static std::atomic<bool> ntTraceActive(false);
+static std::atomic<int> ntTraceSession(0);
+static std::atomic<long long> ntTraceStartTicks(0); //steady_clock ticks at NtBeginTrace, read while recording
+static size_t ntTraceCapacity = NT_TRACE_DEFAULT_CAPACITY;
+static std::mutex ntTraceMutex; //Buffer handout and export only, never taken while recording
+//Buffers live until the process exits, a thread may still write to its buffer of an earlier trace
+static std::vector<std::unique_ptr<NtTraceBuffer>> ntTraceBuffers;
+static std::vector<NtTraceBuffer*> ntTraceFreeBuffers;
+
+//Returns a thread's buffer to the free list, ntTraceMutex must be held
+static void NtReleaseTraceBuffer(NtTraceBuffer* buffer) {
+	buffer->owned = false;
+	ntTraceFreeBuffers.push_back(buffer);
+}
+
+//Per thread handle to its buffer, returned to the free list when the thread exits or moves on to a new trace
+typedef struct NtTraceThread {
+	NtTraceBuffer* buffer = nullptr;
+	int session = -1;
+	~NtTraceThread() {
+		std::lock_guard<std::mutex> lock(ntTraceMutex);
+		if (buffer != nullptr) NtReleaseTraceBuffer(buffer);
+	}
+} NtTraceThread;
+static thread_local NtTraceThread ntTraceThread;
+
+static double NtTraceMicroseconds() {
+	long long ticks = std::chrono::steady_clock::now().time_since_epoch().count() - ntTraceStartTicks.load(std::memory_order_relaxed);
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::duration(ticks)).count();
+}
+
+static void NtTraceRecord(const char* name, const char* detail, double start, double end) {
+	NtTraceThread& thread = ntTraceThread;
+	int session = ntTraceSession.load(std::memory_order_acquire);
+	if (thread.session != session) {
+		//Free buffers have no writer left, so buffers of an earlier trace are cleared here rather than in NtBeginTrace.
+		//One freed by a thread that exited during this trace keeps its events and is appended to.
+		std::lock_guard<std::mutex> lock(ntTraceMutex);
+		if (thread.buffer != nullptr) NtReleaseTraceBuffer(thread.buffer);
+		if (ntTraceFreeBuffers.empty()) {
+			ntTraceBuffers.emplace_back(new NtTraceBuffer());
+			ntTraceBuffers.back()->lane = (int)ntTraceBuffers.size() - 1;
+			ntTraceFreeBuffers.push_back(ntTraceBuffers.back().get());
+		}
+		thread.buffer = ntTraceFreeBuffers.back();
+		thread.session = session;
+		ntTraceFreeBuffers.pop_back();
+		if (thread.buffer->session != session) {
+			thread.buffer->events.resize(ntTraceCapacity);
+			thread.buffer->head.store(0, std::memory_order_relaxed);
+			thread.buffer->session = session;
+		}
+		thread.buffer->owned = true;
+	}
+	NtTraceBuffer* buffer = thread.buffer;
+	unsigned long long head = buffer->head.load(std::memory_order_relaxed);
+	NtTraceEvent& event = buffer->events[head % buffer->events.size()];
+	event.name = name;
+	event.detail[0] = 0;
+	if (detail != nullptr) {
+		strncpy(event.detail, detail, sizeof(event.detail) - 1);
+		event.detail[sizeof(event.detail) - 1] = 0;
+	}
+	event.start = start;
+	event.duration = end - start;
+	buffer->head.store(head + 1, std::memory_order_release);
+}
+
+//Records its lifetime as one complete event, costs a relaxed load when no trace is running
+class NtTraceScope {
+private:
+	const char* name;
+	const char* detail;
+	double start = 0;
+	bool active;
+public:
+	NtTraceScope(const char* name, const char* detail = nullptr) : name(name), detail(detail), active(ntTraceActive.load(std::memory_order_relaxed)) {
+		if (active) start = NtTraceMicroseconds();
+	}
+	~NtTraceScope() {
+		if (active) NtTraceRecord(name, detail, start, NtTraceMicroseconds());
+	}
+};
+#define NT_TRACE_SCOPE(...) NtTraceScope ntTraceScope(__VA_ARGS__)
+#else
+#define NT_TRACE_SCOPE(...)
+#endif
 class NTMath {
 public:
 	//Barycentric Coordinates
@@ -32,21 +198,171 @@ public:
 	}
 };
 
+//Read only view of a whole file, memory mapped so loaders scan the page cache directly instead of a private copy
+class NtMappedFile {
+public:
+	NtMappedFile() {}
+	NtMappedFile(const NtMappedFile&) = delete;
+	NtMappedFile& operator=(const NtMappedFile&) = delete;
+	~NtMappedFile() { Close(); }
+
+	bool Open(const std::string& path) {
+		Close();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE) return false;
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize)) return false;
+		size = (size_t)fileSize.QuadPart;
+		if (size == 0) return true;
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL) return false;
+		data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		return data != nullptr;
+#else
+		descriptor = open(path.c_str(), O_RDONLY);
+		if (descriptor < 0) return false;
+		struct stat status;
+		if (fstat(descriptor, &status) != 0) return false;
+		size = (size_t)status.st_size;
+		if (size == 0) return true;
+		void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		if (view == MAP_FAILED) return false;
+		madvise(view, size, MADV_SEQUENTIAL);
+		data = (const char*)view;
+		return true;
+#endif
+	}
+
+	void Close() {
+#ifdef _WIN32
+		if (data != nullptr) UnmapViewOfFile(data);
+		if (mapping != NULL) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (data != nullptr) munmap((void*)data, size);
+		if (descriptor >= 0) close(descriptor);
+		descriptor = -1;
+#endif
+		data = nullptr;
+		size = 0;
+	}
+
+	const char* Begin() const { return size == 0 ? "" : data; }
+	const char* End() const { return Begin() + size; }
+
+private:
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#else
+	int descriptor = -1;
+#endif
+	const char* data = nullptr;
+	size_t size = 0;
+};
+
 //Texture//
-NtTexture::NtTexture(const std::string& filename) {
+//.ntx container: header, then every mip level as RGBA8 in the header's layout, each level 64 byte aligned
+#define NT_TEXTURE_CONTAINER_MAGIC "NTX1"
+#define NT_TEXTURE_FORMAT_RGBA8 0
+
+typedef struct NtTextureContainerHeader {
+	char magic[4];
+	unsigned int width;
+	unsigned int height;
+	unsigned int mipCount;
+	unsigned int format;
+	unsigned int layout;
+	unsigned int tileSize;
+	unsigned int reserved;
+	unsigned long long levelOffset[NT_TEXTURE_MAX_MIPS]; //From the start of the file
+} NtTextureContainerHeader;
+
+/// <summary>
+/// Block addressing of one level, tiles have a fixed side and Morton uses the largest power of two square
+/// that fits so only the last block row and column carry padding
+/// </summary>
+void NtTexture::LevelAddressing(int width, int height, NT_TEXTURE_LAYOUT layout, int tileSize, int& pitch, int& shift) {
+	shift = 0;
+	if (layout == NT_TEXTURE_LINEAR) {
+		pitch = width;
+		return;
+	}
+	int side = layout == NT_TEXTURE_TILED ? tileSize : std::min(width, height);
+	while ((2 << shift) <= side) shift++;
+	pitch = (width + (1 << shift) - 1) >> shift;
+}
+
+/// <summary>
+/// Bytes one level occupies in a layout, blocked levels are padded to whole blocks
+/// </summary>
+size_t NtTexture::LevelBytes(int width, int height, NT_TEXTURE_LAYOUT layout, int tileSize) {
+	int pitch, shift;
+	LevelAddressing(width, height, layout, tileSize, pitch, shift);
+	if (layout == NT_TEXTURE_LINEAR) {
+		return (size_t)width * height * 4;
+	}
+	size_t blockRows = (height + (1 << shift) - 1) >> shift;
+	return ((size_t)pitch * blockRows << (2 * shift)) * 4;
+}
+
+NtTexture::NtTexture(const std::string& filename, NT_TEXTURE_LAYOUT layout, int tileSize) {
+	NT_TRACE_SCOPE("NtTexture", filename.c_str());
+	std::shared_ptr<NtMappedFile> file = std::make_shared<NtMappedFile>();
+	if (!file->Open(filename)) {
+		NtLog(std::cerr, "NtTexture: Error opening file " + filename + "\n");
+		width = 0;
+		height = 0;
+		return;
+	}
+	Load(filename, file->Begin(), file->End(), file, layout, tileSize);
+}
+
+NtTexture::NtTexture(const std::string& filename, const char* begin, const char* end, const std::shared_ptr<void>& owner,
+	NT_TEXTURE_LAYOUT layout, int tileSize) {
+	NT_TRACE_SCOPE("NtTexture", filename.c_str());
+	Load(filename, begin, end, owner, layout, tileSize);
+}
+
+void NtTexture::Load(const std::string& filename, const char* begin, const char* end, const std::shared_ptr<void>& owner,
+	NT_TEXTURE_LAYOUT layout, int tileSize) {
 	width = 0;
 	height = 0;
-	std::ifstream file(filename, std::ios::binary);
-	if (!file.is_open()) {
-		std::cerr << "NtTexture: Error opening file " << filename << "\n";
+	bool container = filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".ntx") == 0;
+	bool loaded = container ? LoadContainer(filename, begin, end, owner) : LoadPPM(filename, begin, end, layout, tileSize);
+	if (!loaded) {
+		width = 0;
+		height = 0;
+		mipCount = 0;
 		return;
 	}
+	NtLog(std::cout, "Texture read: " + filename + " width: " + std::to_string(width) + " height: " + std::to_string(height) + "\n");
+}
+
+//Read only stream over bytes already in memory, lets the PPM header parse straight from a mapping
+class NtMemoryStreamBuffer : public std::streambuf {
+public:
+	NtMemoryStreamBuffer(const char* begin, const char* end) {
+		char* data = const_cast<char*>(begin);
+		setg(data, data, data + (end - begin));
+	}
+};
+
+/// <summary>
+/// Decodes a binary PPM into a single RGBA8 level in the target layout
+/// </summary>
+bool NtTexture::LoadPPM(const std::string& filename, const char* begin, const char* end, NT_TEXTURE_LAYOUT targetLayout, int targetTileSize) {
+	NtMemoryStreamBuffer buffer(begin, end);
+	std::istream file(&buffer);
 
 	std::string header;
 	file >> header;
 	if (header != "P6") {
-		std::cerr << "NtTexture: Unsupported file format " << header << "\n";
-		return;
+		NtLog(std::cerr, "NtTexture: Unsupported file format " + header + "\n");
+		return false;
 	}
 
 	file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
@@ -63,9 +379,9 @@ NtTexture::NtTexture(const std::string& filename) {
 	}
 
 	file >> width >> height;
-	if (width <= 0 || height <= 0) {
-		std::cerr << "Texture loading error, invalid size result!\n";
-		return;
+	if (width <= 0 || height <= 0 || width > NT_TEXTURE_MAX_SIZE || height > NT_TEXTURE_MAX_SIZE) {
+		NtLog(std::cerr, "Texture loading error, invalid size result!\n");
+		return false;
 	}
 
 	int maxVal;
@@ -73,37 +389,216 @@ NtTexture::NtTexture(const std::string& filename) {
 	file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
 
 	if (maxVal != 255) {
-		std::cerr << "Unsupported maxVal in PPM: " << maxVal << "\n";
-		return;
+		NtLog(std::cerr, "Unsupported maxVal in PPM: " + std::to_string(maxVal) + "\n");
+		return false;
 	}
 
-	textureData.resize(height, std::vector<NtPixelf>(width));
-	unsigned char rgb[3];
-	for (int y = 0; y < height; ++y) {
-		for (int x = 0; x < width; ++x) {
-			if (!file.read(reinterpret_cast<char*>(rgb), 3)) {
-				std::cerr << "Error reading pixel data at (" << x << ", " << y << ").\n";
-				std::cerr << "Read error: " << (file.eof() ? "End of file reached unexpectedly." : "Unknown error.") << "\n";
-				return;
-			}
+	std::vector<unsigned char> rgb((size_t)width * height * 3);
+	if (!file.read(reinterpret_cast<char*>(rgb.data()), rgb.size())) {
+		NtLog(std::cerr, "Error reading pixel data of " + filename + ", read " + std::to_string(file.gcount()) + " of " + std::to_string(rgb.size()) + " bytes\n");
+		return false;
+	}
 
-			// Normalize the 8-bit values to the range [0, 1] for floating-point
-			textureData[y][x] = {
-				rgb[0] / 255.0f,
-				rgb[1] / 255.0f,
-				rgb[2] / 255.0f,
-				1.0f  // Assuming full opacity for alpha
-			};
+	//Expanded to RGBA8 with full opacity, sampling divides by 255 exactly as the old float decode did
+	texels.resize((size_t)width * height * 4);
+	for (size_t i = 0, count = (size_t)width * height; i < count; i++) {
+		texels[i * 4 + 0] = rgb[i * 3 + 0];
+		texels[i * 4 + 1] = rgb[i * 3 + 1];
+		texels[i * 4 + 2] = rgb[i * 3 + 2];
+		texels[i * 4 + 3] = 255;
+	}
+	layout = NT_TEXTURE_LINEAR;
+	mipCount = 1;
+	levelWidth[0] = width;
+	levelHeight[0] = height;
+	levelPitch[0] = width;
+	levelShift[0] = 0;
+	levelOffset[0] = 0;
+	return SetLayout(targetLayout, targetTileSize);
+}
+
+/// <summary>
+/// Reorders the texels of a decoded texture into another layout, mapped containers are read only
+/// </summary>
+bool NtTexture::SetLayout(NT_TEXTURE_LAYOUT newLayout, int newTileSize) {
+	if (newLayout == NT_TEXTURE_TILED && !ValidTileSize(newTileSize)) {
+		NtLog(std::cerr, "NtTexture: Invalid tile size " + std::to_string(newTileSize) + "\n");
+		return false;
+	}
+	if (mapping) {
+		return false;
+	}
+	if (newLayout == layout && (newLayout != NT_TEXTURE_TILED || newTileSize == tileSize)) {
+		return true;
+	}
+
+	int newPitch[NT_TEXTURE_MAX_MIPS];
+	int newShift[NT_TEXTURE_MAX_MIPS];
+	size_t newOffset[NT_TEXTURE_MAX_MIPS];
+	size_t total = 0;
+	for (int level = 0; level < mipCount; level++) {
+		LevelAddressing(levelWidth[level], levelHeight[level], newLayout, newTileSize, newPitch[level], newShift[level]);
+		newOffset[level] = total;
+		total += LevelBytes(levelWidth[level], levelHeight[level], newLayout, newTileSize);
+	}
+
+	std::vector<unsigned char> reordered(total, 0);
+	for (int level = 0; level < mipCount; level++) {
+		for (int y = 0; y < levelHeight[level]; y++) {
+			for (int x = 0; x < levelWidth[level]; x++) {
+				std::memcpy(&reordered[newOffset[level] + TexelIndex(x, y, newPitch[level], newShift[level], newLayout) * 4], GetTexel(x, y, level), 4);
+			}
 		}
 	}
 
+	texels.swap(reordered);
+	layout = newLayout;
+	tileSize = newTileSize;
+	for (int level = 0; level < mipCount; level++) {
+		levelPitch[level] = newPitch[level];
+		levelShift[level] = newShift[level];
+		levelOffset[level] = newOffset[level];
+	}
+	return true;
+}
+
+/// <summary>
+/// Reads an .ntx container, texels are sampled in place from the owner's bytes and nothing is decoded
+/// </summary>
+bool NtTexture::LoadContainer(const std::string& filename, const char* begin, const char* end, const std::shared_ptr<void>& owner) {
+	size_t fileSize = end - begin;
+	NtTextureContainerHeader header;
+	if (fileSize < sizeof(header)) {
+		NtLog(std::cerr, "NtTexture: Truncated container " + filename + "\n");
+		return false;
+	}
+	std::memcpy(&header, begin, sizeof(header));
+	if (std::memcmp(header.magic, NT_TEXTURE_CONTAINER_MAGIC, 4) != 0 || header.format != NT_TEXTURE_FORMAT_RGBA8 ||
+		header.layout > NT_TEXTURE_MORTON || (header.layout == NT_TEXTURE_TILED && !ValidTileSize((int)header.tileSize)) ||
+		header.mipCount == 0 || header.mipCount > NT_TEXTURE_MAX_MIPS || header.width == 0 || header.height == 0 ||
+		header.width > NT_TEXTURE_MAX_SIZE || header.height > NT_TEXTURE_MAX_SIZE) {
+		NtLog(std::cerr, "NtTexture: Unsupported container " + filename + "\n");
+		return false;
+	}
 
-	if (width == 0 || height == 0) {
-		std::cerr << "Texture loading error, invalid size result!\n";
+	width = (int)header.width;
+	height = (int)header.height;
+	layout = (NT_TEXTURE_LAYOUT)header.layout;
+	if (layout == NT_TEXTURE_TILED) {
+		tileSize = (int)header.tileSize;
+	}
+	mipCount = (int)header.mipCount;
+	for (int level = 0; level < mipCount; level++) {
+		levelWidth[level] = std::max(1, width >> level);
+		levelHeight[level] = std::max(1, height >> level);
+		LevelAddressing(levelWidth[level], levelHeight[level], layout, tileSize, levelPitch[level], levelShift[level]);
+		levelOffset[level] = (size_t)header.levelOffset[level];
+		if (header.levelOffset[level] > fileSize || fileSize - levelOffset[level] < LevelBytes(levelWidth[level], levelHeight[level], layout, tileSize)) {
+			NtLog(std::cerr, "NtTexture: Truncated container " + filename + "\n");
+			return false;
+		}
+	}
+	if (owner) {
+		mappedTexels = (const unsigned char*)begin;
+		mapping = owner;
 	}
 	else {
-		std::cout << "Texture read: " << filename << " width: " << width << " height: " << height << "\n";
+		//Level offsets count from the start of the file, so the copy keeps the header too
+		texels.assign(begin, end);
+	}
+	return true;
+}
+
+/// <summary>
+/// Writes a texture as an .ntx container with a full mip chain, each level box filtered from the one above.
+/// The result can be referenced anywhere a PPM texture can, it loads by mapping and costs almost no heap.
+/// </summary>
+/// <param name="texture"></param>
+/// <param name="path"></param>
+/// <param name="layout"></param>
+/// <param name="tileSize">Only used by NT_TEXTURE_TILED</param>
+/// <returns></returns>
+int NtWriteTextureContainer(const NtTexture& texture, const std::string& path, NT_TEXTURE_LAYOUT layout, int tileSize) {
+	if (texture.GetWidth() <= 0 || texture.GetHeight() <= 0) {
+		return NT_FAILURE;
+	}
+	if (layout == NT_TEXTURE_TILED && !NtTexture::ValidTileSize(tileSize)) {
+		NtLog(std::cerr, "Invalid texture tile size " + std::to_string(tileSize) + "\n");
+		return NT_FAILURE;
+	}
+
+	//Linear copies of every level
+	std::vector<std::vector<unsigned char>> levels;
+	std::vector<int> widths, heights;
+	int w = texture.GetWidth();
+	int h = texture.GetHeight();
+	levels.emplace_back((size_t)w * h * 4);
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			std::memcpy(&levels[0][((size_t)y * w + x) * 4], texture.GetTexel(x, y), 4);
+		}
+	}
+	widths.push_back(w);
+	heights.push_back(h);
+	while ((w > 1 || h > 1) && (int)levels.size() < NT_TEXTURE_MAX_MIPS) {
+		int nextW = std::max(1, w >> 1);
+		int nextH = std::max(1, h >> 1);
+		const std::vector<unsigned char>& source = levels.back();
+		std::vector<unsigned char> level((size_t)nextW * nextH * 4);
+		for (int y = 0; y < nextH; y++) {
+			for (int x = 0; x < nextW; x++) {
+				int x0 = std::min(x * 2, w - 1), x1 = std::min(x * 2 + 1, w - 1);
+				int y0 = std::min(y * 2, h - 1), y1 = std::min(y * 2 + 1, h - 1);
+				for (int c = 0; c < 4; c++) {
+					int sum = source[((size_t)y0 * w + x0) * 4 + c] + source[((size_t)y0 * w + x1) * 4 + c] +
+						source[((size_t)y1 * w + x0) * 4 + c] + source[((size_t)y1 * w + x1) * 4 + c];
+					level[((size_t)y * nextW + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+		levels.push_back(std::move(level));
+		widths.push_back(nextW);
+		heights.push_back(nextH);
+		w = nextW;
+		h = nextH;
+	}
+
+	NtTextureContainerHeader header = {};
+	std::memcpy(header.magic, NT_TEXTURE_CONTAINER_MAGIC, 4);
+	header.width = texture.GetWidth();
+	header.height = texture.GetHeight();
+	header.mipCount = (unsigned int)levels.size();
+	header.format = NT_TEXTURE_FORMAT_RGBA8;
+	header.layout = layout;
+	header.tileSize = layout == NT_TEXTURE_TILED ? tileSize : 0;
+	size_t offset = (sizeof(header) + 63) & ~(size_t)63;
+	for (size_t level = 0; level < levels.size(); level++) {
+		header.levelOffset[level] = offset;
+		offset = (offset + NtTexture::LevelBytes(widths[level], heights[level], layout, tileSize) + 63) & ~(size_t)63;
+	}
+
+	//Reorder each level into the target layout, padding texels stay zero
+	std::vector<unsigned char> file(offset, 0);
+	std::memcpy(file.data(), &header, sizeof(header));
+	for (size_t level = 0; level < levels.size(); level++) {
+		int levelW = widths[level];
+		unsigned char* destination = file.data() + header.levelOffset[level];
+		int pitch, shift;
+		NtTexture::LevelAddressing(levelW, heights[level], layout, tileSize, pitch, shift);
+		for (int y = 0; y < heights[level]; y++) {
+			for (int x = 0; x < levelW; x++) {
+				size_t index = NtTexture::TexelIndex(x, y, pitch, shift, layout);
+				std::memcpy(destination + index * 4, &levels[level][((size_t)y * levelW + x) * 4], 4);
+			}
+		}
+	}
+
+	std::ofstream output(path, std::ios::binary);
+	if (!output.is_open() || !output.write((const char*)file.data(), file.size())) {
+		NtLog(std::cerr, "Failed to write texture container " + path + "\n");
+		return NT_FAILURE;
 	}
+	return NT_SUCCESS;
 }
 
 NtPixelf NtTextureLookUp(float u, float v, const NtTexture& texture, bool horizontalFlip) {
@@ -157,6 +652,20 @@ int NtSetShadingMode(NtRender* render, NT_SHADING_MODE mode) {
 	return NT_SUCCESS;
 }
 
+/// <summary>
+/// Turns the depth test on or off, with it off triangles are drawn in submission order
+/// </summary>
+/// <param name="render"></param>
+/// <param name="depthTest"></param>
+/// <returns></returns>
+int NtSetDepthTest(NtRender* render, bool depthTest) {
+	if (render == nullptr)
+		return NT_FAILURE;
+
+	render->depthTest = depthTest;
+	return NT_SUCCESS;
+}
+
 /// <summary>
 /// Creates a frame buffer and allocates memory of size NtPixel x width x height and passes back pointer
 /// </summary>
@@ -183,7 +692,7 @@ int NtNewFrameBuffer(NtPixel** frameBuffer, int width, int height)
 /// <param name="xRes"></param>
 /// <param name="yRes"></param>
 /// <returns></returns>
-int NtNewDisplay(NtDisplay** display, int xRes, int yRes, Vector4 backgroundColor, int aaSampleCount)
+int NtNewDisplay(NtDisplay** display, int xRes, int yRes, Vector4 backgroundColor, int aaSampleCount, NT_AA_PATTERN aaPattern, NT_AA_FILTER aaFilter)
 {
 	*display = new NtDisplay();
 	(*display)->xRes = xRes;
@@ -192,7 +701,7 @@ int NtNewDisplay(NtDisplay** display, int xRes, int yRes, Vector4 backgroundColo
 
 	status |= NtNewFrameBuffer(&((*display)->frameBuffer), xRes, yRes);
 	status |= NtInitDisplay(*display, backgroundColor, aaSampleCount);
-	status |= NtLoadAAFilter(*display);
+	status |= NtLoadAAFilter(*display, aaPattern, aaFilter);
 	return status ? NT_FAILURE : NT_SUCCESS;
 }
 
@@ -203,13 +712,18 @@ int NtNewDisplay(NtDisplay** display, int xRes, int yRes, Vector4 backgroundColo
 /// <returns></returns>
 int NtFreeDisplay(NtDisplay* display)
 {
-	delete display;
+	if (display == nullptr) return NT_FAILURE;
 	/* clean up, free memory */
+	delete[] display->frameBuffer;
+	for (NtPixel* buffer : display->sampleBuffer) {
+		delete[] buffer;
+	}
+	delete display;
 	return NT_SUCCESS;
 }
 
 /// <summary>
-/// Initializes an empty display with all pixels set to background color
+/// Initializes an empty display with all pixels set to background color, (re)allocating aaSampleCount sample buffers
 /// </summary>
 /// <param name="display"></param>
 /// <returns></returns>
@@ -217,31 +731,95 @@ int NtInitDisplay(NtDisplay* display, const Vector4& backgroundColor, int aaSamp
 {
 	if (display == nullptr || display->frameBuffer == nullptr) return NT_FAILURE;
 	display->sampleCount = aaSampleCount;
-	//Todo: we could cache buffer size
-	int bufferSize = display->xRes * display->yRes;
-	for (int i = 0; i < bufferSize; i++) {
-		display->frameBuffer[i].r = NTMath::fts(backgroundColor.x);
-		display->frameBuffer[i].g = NTMath::fts(backgroundColor.y);
-		display->frameBuffer[i].b = NTMath::fts(backgroundColor.z);
-		display->frameBuffer[i].a = NTMath::fts(backgroundColor.w);
-	}
+	display->tileCountX = (display->xRes + NT_CLEAR_TILE_SIZE - 1) / NT_CLEAR_TILE_SIZE;
+	display->tileCountY = (display->yRes + NT_CLEAR_TILE_SIZE - 1) / NT_CLEAR_TILE_SIZE;
+	display->tilePending.assign((1 + std::max(aaSampleCount, 0)) * display->tileCountX * display->tileCountY, 0);
+	display->pendingTileCount = 0;
 
 	//Init sample buffer
-	display->sampleBuffer.resize(aaSampleCount);
+	for (NtPixel* buffer : display->sampleBuffer) {
+		delete[] buffer;
+	}
+	display->sampleBuffer.assign(std::max(aaSampleCount, 0), nullptr);
 	for (int i = 0; i < aaSampleCount; i++) {
-		NtPixel* buffer;
-		NtNewFrameBuffer(&buffer, display->xRes, display->yRes);
-		display->sampleBuffer[i] = buffer;
+		NtNewFrameBuffer(&display->sampleBuffer[i], display->xRes, display->yRes);
 	}
 
-	//Init sample buffer
-	for (int i = 0; i < aaSampleCount; i++) {
-		for (int j = 0; j < bufferSize; j++) {
-			display->sampleBuffer[i][j].r = NTMath::fts(backgroundColor.x);
-			display->sampleBuffer[i][j].g = NTMath::fts(backgroundColor.y);
-			display->sampleBuffer[i][j].b = NTMath::fts(backgroundColor.z);
-			display->sampleBuffer[i][j].a = NTMath::fts(backgroundColor.w);
-		}
+	return NtClearDisplay(display, backgroundColor);
+}
+
+/// <summary>
+/// Clears the frame buffer and every sample buffer to background color, no allocation.
+/// The packed clear pixel is computed once and written with wide stores. With fastClear nothing is written now,
+/// every tile is flagged pending and gets cleared on its first NtPutDisplay instead.
+/// </summary>
+/// <param name="display"></param>
+/// <param name="backgroundColor"></param>
+/// <param name="fastClear"></param>
+/// <returns></returns>
+int NtClearDisplay(NtDisplay* display, const Vector4& backgroundColor, bool fastClear)
+{
+	if (display == nullptr || display->frameBuffer == nullptr) return NT_FAILURE;
+	static_assert(sizeof(NtPixel) == sizeof(unsigned long long), "NtPixel must pack into 64 bits");
+	display->clearPixel.r = NTMath::fts(backgroundColor.x);
+	display->clearPixel.g = NTMath::fts(backgroundColor.y);
+	display->clearPixel.b = NTMath::fts(backgroundColor.z);
+	display->clearPixel.a = NTMath::fts(backgroundColor.w);
+
+	if (fastClear) {
+		std::fill(display->tilePending.begin(), display->tilePending.end(), 1);
+		display->pendingTileCount = static_cast<int>(display->tilePending.size());
+		return NT_SUCCESS;
+	}
+
+	unsigned long long packed;
+	std::memcpy(&packed, &display->clearPixel, sizeof(packed));
+	size_t bufferSize = static_cast<size_t>(display->xRes) * display->yRes;
+	NtFill64(display->frameBuffer, packed, bufferSize);
+	for (NtPixel* buffer : display->sampleBuffer) {
+		NtFill64(buffer, packed, bufferSize);
+	}
+	std::fill(display->tilePending.begin(), display->tilePending.end(), 0);
+	display->pendingTileCount = 0;
+	return NT_SUCCESS;
+}
+
+/// <summary>
+/// Writes the clear pixel into one pending tile of a buffer, bufferIndex follows tilePending (0 = frame buffer)
+/// </summary>
+/// <param name="display"></param>
+/// <param name="bufferIndex"></param>
+/// <param name="tile"></param>
+static void NtClearTile(NtDisplay* display, int bufferIndex, int tile) {
+	unsigned char& pending = display->tilePending[bufferIndex * display->tileCountX * display->tileCountY + tile];
+	if (!pending) return;
+	pending = 0;
+	display->pendingTileCount--;
+
+	NtPixel* buffer = bufferIndex == 0 ? display->frameBuffer : display->sampleBuffer[bufferIndex - 1];
+	unsigned long long packed;
+	std::memcpy(&packed, &display->clearPixel, sizeof(packed));
+	int x0 = (tile % display->tileCountX) * NT_CLEAR_TILE_SIZE;
+	int y0 = (tile / display->tileCountX) * NT_CLEAR_TILE_SIZE;
+	int width = std::min(NT_CLEAR_TILE_SIZE, display->xRes - x0);
+	int yEnd = std::min(y0 + NT_CLEAR_TILE_SIZE, static_cast<int>(display->yRes));
+	for (int y = y0; y < yEnd; y++) {
+		NtFill64(buffer + x0 + y * display->xRes, packed, width);
+	}
+}
+
+/// <summary>
+/// Writes the clear pixel into every frame buffer tile still pending a fast clear, call before reading the frame buffer.
+/// Sample buffers never need this, NtAverageSampleToFrameBuffer reads pending sample tiles as the clear pixel.
+/// </summary>
+/// <param name="display"></param>
+/// <returns></returns>
+int NtResolveFastClear(NtDisplay* display) {
+	if (display == nullptr) return NT_FAILURE;
+	if (display->pendingTileCount == 0) return NT_SUCCESS;
+	int tileCount = display->tileCountX * display->tileCountY;
+	for (int tile = 0; tile < tileCount; tile++) {
+		NtClearTile(display, 0, tile);
 	}
 	return NT_SUCCESS;
 }
@@ -261,12 +839,14 @@ int NtInitDisplay(NtDisplay* display, const Vector4& backgroundColor, int aaSamp
 int NtPutDisplay(NtDisplay* display, int i, int j, short r, short g, short b, short a, int aaFilterIndex)
 {
 	if (display == nullptr || display->frameBuffer == nullptr) return NT_FAILURE;
-	if (aaFilterIndex >= 0) {
-		NtAAShift aaShift = display->aaShifts[aaFilterIndex];
-		i += aaShift.shiftX;
-		j += aaShift.shiftY;
+	//Sample renders are already jittered at triangle setup, writes outside the display are dropped
+	if (i < 0 || i >= display->xRes || j < 0 || j >= display->yRes) return NT_FAILURE;
+	//-1 = the frame buffer, checked before the index picks a pending tile set or sample buffer
+	if (aaFilterIndex < -1 || aaFilterIndex >= display->sampleCount) return NT_FAILURE;
+	int index = i + j * display->xRes;
+	if (display->pendingTileCount > 0) {
+		NtClearTile(display, aaFilterIndex + 1, i / NT_CLEAR_TILE_SIZE + (j / NT_CLEAR_TILE_SIZE) * display->tileCountX);
 	}
-	int index = ClipInt(i, 0, display->xRes) + ClipInt(j, 0, display->yRes) * display->xRes;
 
 	//No anti-aliasing, directly write the frame buffer
 	if (aaFilterIndex == -1) {
@@ -276,8 +856,6 @@ int NtPutDisplay(NtDisplay* display, int i, int j, short r, short g, short b, sh
 		display->frameBuffer[index].a = a;
 	}
 	else {
-		if (aaFilterIndex < 0 || aaFilterIndex >= display->sampleCount)
-			return NT_FAILURE;
 		display->sampleBuffer[aaFilterIndex][index].r = r;
 		display->sampleBuffer[aaFilterIndex][index].g = g;
 		display->sampleBuffer[aaFilterIndex][index].b = b;
@@ -288,36 +866,183 @@ int NtPutDisplay(NtDisplay* display, int i, int j, short r, short g, short b, sh
 }
 
 /// <summary>
-/// Takes the average of current sample buffers and write the averaged pixel to frame buffer
+/// Takes the weighted average of current sample buffers and write the averaged pixel to frame buffer.
+/// Sums are kept in float so 16 box filtered samples can't overflow or truncate per tap.
 /// </summary>
 /// <param name="display"></param>
 /// <returns></returns>
-int NtAverageSampleToFrameBuffer(NtDisplay* display) {
+int NtAverageSampleToFrameBuffer(NtDisplay* display, const NtAAEdgeMask* edgeMask) {
 	if (display == nullptr) return NT_FAILURE;
+	NT_TRACE_SCOPE("NtAverageSampleToFrameBuffer");
 	if (display->sampleCount <= 0) return NT_SUCCESS;
+	if (static_cast<int>(display->aaShifts.size()) < display->sampleCount) return NT_FAILURE;
+	//Adaptive keeps non edge pixels from the frame buffer, so it must be fully cleared first
+	if (edgeMask != nullptr) NtResolveFastClear(display);
+
+	float weightSum = 0.0f;
+	for (int j = 0; j < display->sampleCount; j++) {
+		weightSum += display->aaShifts[j].weight;
+	}
+
+	//Resolve tile by tile so samples still pending a fast clear are read as the clear pixel without being written
+	int tilesPerBuffer = display->tileCountX * display->tileCountY;
+	NtParallelFor(0, display->tileCountY, [&](int tileRowBegin, int tileRowEnd) {
+		std::vector<const NtPixel*> samples(display->sampleCount);
+		for (int tileY = tileRowBegin; tileY < tileRowEnd; tileY++) {
+			for (int tileX = 0; tileX < display->tileCountX; tileX++) {
+				int tile = tileX + tileY * display->tileCountX;
+				for (int j = 0; j < display->sampleCount; j++) {
+					samples[j] = display->tilePending[(j + 1) * tilesPerBuffer + tile] ? nullptr : display->sampleBuffer[j];
+				}
+				//A full resolve overwrites the whole tile, no need to clear it first
+				display->tilePending[tile] = 0;
+
+				int xEnd = std::min((tileX + 1) * NT_CLEAR_TILE_SIZE, static_cast<int>(display->xRes));
+				int yEnd = std::min((tileY + 1) * NT_CLEAR_TILE_SIZE, static_cast<int>(display->yRes));
+				for (int y = tileY * NT_CLEAR_TILE_SIZE; y < yEnd; y++) {
+					for (int x = tileX * NT_CLEAR_TILE_SIZE; x < xEnd; x++) {
+						int i = x + y * display->xRes;
+						if (edgeMask != nullptr && !edgeMask->mask[i]) continue;
+
+						float rSum = 0, gSum = 0, bSum = 0, aSum = 0;
+						for (int j = 0; j < display->sampleCount; j++) {
+							float weight = display->aaShifts[j].weight;
+							const NtPixel& sample = samples[j] ? samples[j][i] : display->clearPixel;
+							rSum += sample.r * weight;
+							gSum += sample.g * weight;
+							bSum += sample.b * weight;
+							aSum += sample.a * weight;
+						}
+
+						display->frameBuffer[i].r = static_cast<unsigned short>(rSum / weightSum);
+						display->frameBuffer[i].g = static_cast<unsigned short>(gSum / weightSum);
+						display->frameBuffer[i].b = static_cast<unsigned short>(bSum / weightSum);
+						display->frameBuffer[i].a = static_cast<unsigned short>(aSum / weightSum);
+					}
+				}
+			}
+		}
+	}, 4);
 
-	int bufferSize = display->xRes * display->yRes;
-	for (int i = 0; i < bufferSize; i++) {
-		short rSum = 0, gSum = 0, bSum = 0, aSum = 0;
-		float weightSum = 0.0f;
+	display->pendingTileCount = static_cast<int>(std::count(display->tilePending.begin(), display->tilePending.end(), 1));
+	return NT_SUCCESS;
+}
 
-		for (int j = 0; j < display->sampleCount; j++) {
-			float weight = display->aaShifts[j].weight;
-			weightSum += weight;
+/// <summary>
+/// Builds the adaptive anti-aliasing mask from a single sample render with an id buffer.
+/// Both pixels across a discontinuity are marked: coverage changes, or a primitive change with a depth jump
+/// or a color difference above threshold. Returns NT_FAILURE if the render has no id buffer.
+/// </summary>
+/// <param name="render"></param>
+/// <param name="depthThreshold"></param>
+/// <param name="colorThreshold"></param>
+/// <param name="edgeMask"></param>
+/// <returns></returns>
+int NtDetectAAEdges(const NtRender* render, float depthThreshold, float colorThreshold, NtAAEdgeMask& edgeMask) {
+	if (render == nullptr || render->idBuffer == nullptr) return NT_FAILURE;
+	NT_TRACE_SCOPE("NtDetectAAEdges");
+	NtResolveFastClear(render->display);
+	const NtDisplay* display = render->display;
+	int xRes = display->xRes;
+	int yRes = display->yRes;
+	int colorLimit = static_cast<int>(colorThreshold * ((1 << 12) - 1));
+
+	edgeMask.mask.assign(xRes * yRes, 0);
+	edgeMask.rowMin.assign(yRes, xRes);
+	edgeMask.rowMax.assign(yRes, -1);
+	edgeMask.edgeCount = 0;
+
+	auto isEdge = [&](int x0, int y0, int x1, int y1) {
+		int id0 = render->idBuffer[x0 + y0 * xRes];
+		int id1 = render->idBuffer[x1 + y1 * xRes];
+		if (id0 != id1) {
+			if (id0 < 0 || id1 < 0) return true;
+			if (std::fabs(render->zBuffer[x0][y0] - render->zBuffer[x1][y1]) > depthThreshold) return true;
+		}
 
-			rSum += display->sampleBuffer[j][i].r * weight;
-			gSum += display->sampleBuffer[j][i].g * weight;
-			bSum += display->sampleBuffer[j][i].b * weight;
-			aSum += display->sampleBuffer[j][i].a * weight;
+		//Color contrast also catches shading and texture edges inside a triangle
+		const NtPixel& p0 = display->frameBuffer[x0 + y0 * xRes];
+		const NtPixel& p1 = display->frameBuffer[x1 + y1 * xRes];
+		return std::abs(p0.r - p1.r) > colorLimit || std::abs(p0.g - p1.g) > colorLimit || std::abs(p0.b - p1.b) > colorLimit;
+	};
+	auto mark = [&](int x, int y) {
+		unsigned char& m = edgeMask.mask[x + y * xRes];
+		if (m) return;
+		m = 1;
+		edgeMask.edgeCount++;
+		edgeMask.rowMin[y] = std::min(edgeMask.rowMin[y], x);
+		edgeMask.rowMax[y] = std::max(edgeMask.rowMax[y], x);
+	};
+
+	//Compare against right and bottom neighbors, covers every 4-connected pair once
+	for (int y = 0; y < yRes; y++) {
+		for (int x = 0; x < xRes; x++) {
+			if (x + 1 < xRes && isEdge(x, y, x + 1, y)) {
+				mark(x, y);
+				mark(x + 1, y);
+			}
+			if (y + 1 < yRes && isEdge(x, y, x, y + 1)) {
+				mark(x, y);
+				mark(x, y + 1);
+			}
 		}
+	}
+	return NT_SUCCESS;
+}
+
+/// <summary>
+/// Single threaded fill of count 8 byte elements using 16 byte stores, unrolled to 64 bytes per iteration
+/// </summary>
+static void NtFill64Serial(unsigned char* out, unsigned long long value, size_t count) {
+	size_t i = 0;
+#ifdef NT_HAS_SSE2
+	__m128i wide = _mm_set1_epi64x(static_cast<long long>(value));
+	for (; i + 8 <= count; i += 8) {
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 8), wide);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 8 + 16), wide);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 8 + 32), wide);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 8 + 48), wide);
+	}
+#endif
+	for (; i < count; i++) {
+		std::memcpy(out + i * 8, &value, 8);
+	}
+}
 
-		display->frameBuffer[i].r = static_cast<unsigned short>(rSum / weightSum);
-		display->frameBuffer[i].g = static_cast<unsigned short>(gSum / weightSum);
-		display->frameBuffer[i].b = static_cast<unsigned short>(bSum / weightSum);
-		display->frameBuffer[i].a = static_cast<unsigned short>(aSum / weightSum);
+/// <summary>
+/// Fills count 8 byte elements at destination with value using wide stores, large buffers are split across cores
+/// </summary>
+/// <param name="destination"></param>
+/// <param name="value"></param>
+/// <param name="count"></param>
+void NtFill64(void* destination, unsigned long long value, size_t count) {
+	unsigned char* out = static_cast<unsigned char*>(destination);
+	if (count < NT_PARALLEL_FILL_MIN) {
+		NtFill64Serial(out, value, count);
+		return;
 	}
 
-	return NT_SUCCESS;
+	//Split on whole 8 element blocks so every chunk runs the unrolled loop without a tail
+	int blockCount = static_cast<int>(count / 8);
+	NtParallelFor(0, blockCount, [&](int blockBegin, int blockEnd) {
+		NtFill64Serial(out + static_cast<size_t>(blockBegin) * 64, value, static_cast<size_t>(blockEnd - blockBegin) * 8);
+	}, NT_PARALLEL_FILL_MIN / 32);
+	NtFill64Serial(out + static_cast<size_t>(blockCount) * 64, value, count % 8);
+}
+
+/// <summary>
+/// Fills count 4 byte elements at destination with value, used for depth and id buffers
+/// </summary>
+/// <param name="destination"></param>
+/// <param name="value"></param>
+/// <param name="count"></param>
+void NtFill32(void* destination, unsigned int value, size_t count) {
+	unsigned char* out = static_cast<unsigned char*>(destination);
+	unsigned long long packed = (static_cast<unsigned long long>(value) << 32) | value;
+	NtFill64(out, packed, count / 2);
+	if (count % 2) {
+		std::memcpy(out + (count - 1) * 4, &value, 4);
+	}
 }
 
 /// <summary>
@@ -352,6 +1077,310 @@ void ClipVec3(Vector3& vec) {
 	vec.y = Clipf(vec.y, 0, 1);
 	vec.z = Clipf(vec.z, 0, 1);
 }
+
+/// <summary>
+/// Luma in [0, 1] of a frame buffer pixel
+/// </summary>
+static inline float NtPixelLuma(const NtPixel& pixel) {
+	return (0.299f * pixel.r + 0.587f * pixel.g + 0.114f * pixel.b) * (1.0f / ((1 << 12) - 1));
+}
+
+/// <summary>
+/// Post-process FXAA (quality preset 12 steps) on the display frame buffer, runs in parallel across rows.
+/// Luma is computed once into a flat buffer so the edge search and bilinear fetches stay cheap.
+/// </summary>
+/// <param name="display"></param>
+/// <param name="edgeThreshold"></param>
+/// <param name="edgeThresholdMin"></param>
+/// <param name="subpixelQuality"></param>
+/// <returns></returns>
+int NtApplyFXAA(NtDisplay* display, float edgeThreshold, float edgeThresholdMin, float subpixelQuality) {
+	if (display == nullptr || display->frameBuffer == nullptr) return NT_FAILURE;
+	NT_TRACE_SCOPE("NtApplyFXAA");
+	NtResolveFastClear(display);
+	const int xRes = display->xRes;
+	const int yRes = display->yRes;
+	const NtPixel* source = display->frameBuffer;
+	std::vector<float> luma(xRes * yRes);
+	std::vector<NtPixel> result(xRes * yRes);
+
+	NtParallelFor(0, yRes, [&](int rowBegin, int rowEnd) {
+		for (int i = rowBegin * xRes; i < rowEnd * xRes; i++) {
+			luma[i] = NtPixelLuma(source[i]);
+		}
+	}, 16);
+
+	//Clamp to edge fetches, coordinates are in pixels with centers at +0.5
+	auto lumaAt = [&](int x, int y) {
+		return luma[ClipInt(x, 0, xRes - 1) + ClipInt(y, 0, yRes - 1) * xRes];
+	};
+	auto lumaBilinear = [&](float px, float py) {
+		float fx = px - 0.5f, fy = py - 0.5f;
+		int x0 = static_cast<int>(std::floor(fx)), y0 = static_cast<int>(std::floor(fy));
+		float tx = fx - x0, ty = fy - y0;
+		float top = lumaAt(x0, y0) * (1 - tx) + lumaAt(x0 + 1, y0) * tx;
+		float bottom = lumaAt(x0, y0 + 1) * (1 - tx) + lumaAt(x0 + 1, y0 + 1) * tx;
+		return top * (1 - ty) + bottom * ty;
+	};
+	auto colorBilinear = [&](float px, float py) {
+		float fx = px - 0.5f, fy = py - 0.5f;
+		int x0 = static_cast<int>(std::floor(fx)), y0 = static_cast<int>(std::floor(fy));
+		float tx = fx - x0, ty = fy - y0;
+		int xa = ClipInt(x0, 0, xRes - 1), xb = ClipInt(x0 + 1, 0, xRes - 1);
+		int ya = ClipInt(y0, 0, yRes - 1), yb = ClipInt(y0 + 1, 0, yRes - 1);
+		const NtPixel& p00 = source[xa + ya * xRes];
+		const NtPixel& p10 = source[xb + ya * xRes];
+		const NtPixel& p01 = source[xa + yb * xRes];
+		const NtPixel& p11 = source[xb + yb * xRes];
+		float w00 = (1 - tx) * (1 - ty), w10 = tx * (1 - ty), w01 = (1 - tx) * ty, w11 = tx * ty;
+		NtPixel out;
+		out.r = static_cast<unsigned short>(p00.r * w00 + p10.r * w10 + p01.r * w01 + p11.r * w11 + 0.5f);
+		out.g = static_cast<unsigned short>(p00.g * w00 + p10.g * w10 + p01.g * w01 + p11.g * w11 + 0.5f);
+		out.b = static_cast<unsigned short>(p00.b * w00 + p10.b * w10 + p01.b * w01 + p11.b * w11 + 0.5f);
+		out.a = static_cast<unsigned short>(p00.a * w00 + p10.a * w10 + p01.a * w01 + p11.a * w11 + 0.5f);
+		return out;
+	};
+
+	static const int searchSteps = 12;
+	static const float searchQuality[searchSteps] = { 1, 1, 1, 1, 1, 1.5f, 2, 2, 2, 2, 4, 8 };
+
+	NtParallelFor(0, yRes, [&](int rowBegin, int rowEnd) {
+		for (int y = rowBegin; y < rowEnd; y++) {
+			for (int x = 0; x < xRes; x++) {
+				int index = x + y * xRes;
+				float lumaCenter = luma[index];
+				float lumaDown = lumaAt(x, y + 1);
+				float lumaUp = lumaAt(x, y - 1);
+				float lumaLeft = lumaAt(x - 1, y);
+				float lumaRight = lumaAt(x + 1, y);
+
+				float lumaMin = Min(lumaCenter, Min(Min(lumaDown, lumaUp), Min(lumaLeft, lumaRight)));
+				float lumaMax = Max(lumaCenter, Max(Max(lumaDown, lumaUp), Max(lumaLeft, lumaRight)));
+				float lumaRange = lumaMax - lumaMin;
+
+				//Low contrast, not an edge
+				if (lumaRange < Max(edgeThresholdMin, lumaMax * edgeThreshold)) {
+					result[index] = source[index];
+					continue;
+				}
+
+				float lumaDownLeft = lumaAt(x - 1, y + 1);
+				float lumaUpRight = lumaAt(x + 1, y - 1);
+				float lumaUpLeft = lumaAt(x - 1, y - 1);
+				float lumaDownRight = lumaAt(x + 1, y + 1);
+
+				float lumaDownUp = lumaDown + lumaUp;
+				float lumaLeftRight = lumaLeft + lumaRight;
+				float lumaLeftCorners = lumaDownLeft + lumaUpLeft;
+				float lumaDownCorners = lumaDownLeft + lumaDownRight;
+				float lumaRightCorners = lumaDownRight + lumaUpRight;
+				float lumaUpCorners = lumaUpRight + lumaUpLeft;
+
+				//Estimate edge orientation from second derivatives
+				float edgeHorizontal = std::fabs(-2 * lumaLeft + lumaLeftCorners) + std::fabs(-2 * lumaCenter + lumaDownUp) * 2 + std::fabs(-2 * lumaRight + lumaRightCorners);
+				float edgeVertical = std::fabs(-2 * lumaUp + lumaUpCorners) + std::fabs(-2 * lumaCenter + lumaLeftRight) * 2 + std::fabs(-2 * lumaDown + lumaDownCorners);
+				bool isHorizontal = edgeHorizontal >= edgeVertical;
+
+				//Pick the side of the pixel the edge lies on
+				float luma1 = isHorizontal ? lumaUp : lumaLeft;
+				float luma2 = isHorizontal ? lumaDown : lumaRight;
+				float gradient1 = luma1 - lumaCenter;
+				float gradient2 = luma2 - lumaCenter;
+				bool is1Steepest = std::fabs(gradient1) >= std::fabs(gradient2);
+				float gradientScaled = 0.25f * Max(std::fabs(gradient1), std::fabs(gradient2));
+
+				float stepLength = 1.0f;
+				float lumaLocalAverage;
+				if (is1Steepest) {
+					stepLength = -stepLength;
+					lumaLocalAverage = 0.5f * (luma1 + lumaCenter);
+				}
+				else {
+					lumaLocalAverage = 0.5f * (luma2 + lumaCenter);
+				}
+
+				//Start on the edge, half a pixel towards the steepest side
+				float centerX = x + 0.5f, centerY = y + 0.5f;
+				float currentX = centerX, currentY = centerY;
+				if (isHorizontal) currentY += stepLength * 0.5f;
+				else currentX += stepLength * 0.5f;
+				float offsetX = isHorizontal ? 1.0f : 0.0f;
+				float offsetY = isHorizontal ? 0.0f : 1.0f;
+
+				//Walk both directions along the edge until the luma leaves the local average
+				float x1 = currentX - offsetX, y1 = currentY - offsetY;
+				float x2 = currentX + offsetX, y2 = currentY + offsetY;
+				float lumaEnd1 = lumaBilinear(x1, y1) - lumaLocalAverage;
+				float lumaEnd2 = lumaBilinear(x2, y2) - lumaLocalAverage;
+				bool reached1 = std::fabs(lumaEnd1) >= gradientScaled;
+				bool reached2 = std::fabs(lumaEnd2) >= gradientScaled;
+				for (int i = 1; i < searchSteps && !(reached1 && reached2); i++) {
+					if (!reached1) {
+						x1 -= offsetX * searchQuality[i];
+						y1 -= offsetY * searchQuality[i];
+						lumaEnd1 = lumaBilinear(x1, y1) - lumaLocalAverage;
+						reached1 = std::fabs(lumaEnd1) >= gradientScaled;
+					}
+					if (!reached2) {
+						x2 += offsetX * searchQuality[i];
+						y2 += offsetY * searchQuality[i];
+						lumaEnd2 = lumaBilinear(x2, y2) - lumaLocalAverage;
+						reached2 = std::fabs(lumaEnd2) >= gradientScaled;
+					}
+				}
+
+				float distance1 = isHorizontal ? (centerX - x1) : (centerY - y1);
+				float distance2 = isHorizontal ? (x2 - centerX) : (y2 - centerY);
+				bool isDirection1 = distance1 < distance2;
+				float distanceFinal = Min(distance1, distance2);
+				float edgeThickness = distance1 + distance2;
+				float pixelOffset = -distanceFinal / edgeThickness + 0.5f;
+
+				//Only blend when the luma at the closer edge end varies the same way as the center
+				bool isLumaCenterSmaller = lumaCenter < lumaLocalAverage;
+				bool correctVariation = ((isDirection1 ? lumaEnd1 : lumaEnd2) < 0) != isLumaCenterSmaller;
+				float finalOffset = correctVariation ? pixelOffset : 0;
+
+				//Sub-pixel aliasing, driven by the 3x3 neighborhood contrast
+				float lumaAverage = (1.0f / 12.0f) * (2 * (lumaDownUp + lumaLeftRight) + lumaLeftCorners + lumaRightCorners);
+				float subPixelOffset1 = Clipf(std::fabs(lumaAverage - lumaCenter) / lumaRange, 0, 1);
+				float subPixelOffset2 = (-2 * subPixelOffset1 + 3) * subPixelOffset1 * subPixelOffset1;
+				finalOffset = Max(finalOffset, subPixelOffset2 * subPixelOffset2 * subpixelQuality);
+
+				if (isHorizontal) centerY += finalOffset * stepLength;
+				else centerX += finalOffset * stepLength;
+				result[index] = colorBilinear(centerX, centerY);
+			}
+		}
+	}, 16);
+
+	std::copy(result.begin(), result.end(), display->frameBuffer);
+	return NT_SUCCESS;
+}
+
+/// <summary>
+/// Writes a whole message to stream under a lock so output from concurrent loaders and renders doesn't interleave
+/// </summary>
+/// <param name="stream"></param>
+/// <param name="message"></param>
+void NtLog(std::ostream& stream, const std::string& message) {
+	std::lock_guard<std::mutex> lock(ntLogMutex);
+	stream << message;
+}
+
+//One NtParallelFor call, shared with the pool tasks that help run it. Chunks are claimed through nextChunk, so whoever
+//is free runs them and the caller finishes alone when every worker is busy. Tasks that start after the last chunk was
+//claimed find nothing to do, which is why they hold the job and never the caller's body once it returned.
+typedef struct NtParallelJob {
+	const std::function<void(int, int)>* body;
+	int begin;
+	int end;
+	int chunk;
+	int chunkCount;
+	std::atomic<int> nextChunk{ 0 };
+	std::atomic<int> chunksDone{ 0 };
+	std::mutex mutex;
+	std::condition_variable done;
+} NtParallelJob;
+
+static void NtRunParallelChunks(NtParallelJob& job) {
+	for (int chunk = job.nextChunk++; chunk < job.chunkCount; chunk = job.nextChunk++) {
+		{
+			NT_TRACE_SCOPE("NtParallelFor");
+			int chunkBegin = job.begin + chunk * job.chunk;
+			(*job.body)(chunkBegin, std::min(chunkBegin + job.chunk, job.end));
+		}
+		if (++job.chunksDone == job.chunkCount) {
+			std::lock_guard<std::mutex> lock(job.mutex);
+			job.done.notify_all();
+		}
+	}
+}
+
+//Persistent workers behind NtParallelFor, one per core besides the caller, started on first use and joined at exit
+typedef struct NtWorkerPool {
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<std::shared_ptr<NtParallelJob>> tasks;
+	std::vector<std::thread> workers;
+	bool stopping = false;
+
+	NtWorkerPool() {
+		int workerCount = static_cast<int>(std::thread::hardware_concurrency()) - 1;
+		for (int i = 0; i < workerCount; i++) {
+			workers.emplace_back([this]() {
+				//Chunks run on a pool worker already use a core each, loops nested inside them stay on it
+				ntSerialThread = true;
+				for (;;) {
+					std::shared_ptr<NtParallelJob> job;
+					{
+						std::unique_lock<std::mutex> lock(mutex);
+						wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+						if (stopping) return;
+						job = std::move(tasks.front());
+						tasks.pop_front();
+					}
+					NtRunParallelChunks(*job);
+				}
+			});
+		}
+	}
+	~NtWorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+	}
+} NtWorkerPool;
+
+static NtWorkerPool& NtGetWorkerPool() {
+	static NtWorkerPool pool;
+	return pool;
+}
+
+/// <summary>
+/// Splits [begin, end) into contiguous chunks of at least minChunk and runs body(chunkBegin, chunkEnd) on each,
+/// at most one chunk per hardware core. Chunks run on a persistent worker pool together with the calling thread,
+/// which returns once every chunk is done. Runs serially on frame level worker threads, which already use every core,
+/// and inside chunks that are already running on the pool.
+/// </summary>
+/// <param name="begin"></param>
+/// <param name="end"></param>
+/// <param name="body"></param>
+/// <param name="minChunk"></param>
+void NtParallelFor(int begin, int end, const std::function<void(int, int)>& body, int minChunk) {
+	int count = end - begin;
+	if (count <= 0) return;
+	int threadCount = ntSerialThread ? 1 : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	threadCount = std::min(threadCount, (count + std::max(minChunk, 1) - 1) / std::max(minChunk, 1));
+	if (threadCount <= 1) {
+		body(begin, end);
+		return;
+	}
+
+	std::shared_ptr<NtParallelJob> job = std::make_shared<NtParallelJob>();
+	job->body = &body;
+	job->begin = begin;
+	job->end = end;
+	job->chunk = (count + threadCount - 1) / threadCount;
+	job->chunkCount = (count + job->chunk - 1) / job->chunk;
+	NtWorkerPool& pool = NtGetWorkerPool();
+	{
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		for (int i = 1; i < job->chunkCount; i++) {
+			pool.tasks.push_back(job);
+		}
+	}
+	pool.wake.notify_all();
+	NtRunParallelChunks(*job);
+	std::unique_lock<std::mutex> lock(job->mutex);
+	job->done.wait(lock, [&job]() { return job->chunksDone == job->chunkCount; });
+}
+
 /// <summary>
 /// Flushes display buffer to a ppm file
 /// </summary>
@@ -363,6 +1392,8 @@ int NtFlushDisplayBufferPPM(FILE* outfile, NtDisplay* display)
 
 	/* write pixels to ppm file based on display class -- "P6 %d %d 255\r" */
 	if (display == nullptr || display->frameBuffer == nullptr) return NT_FAILURE;
+	NT_TRACE_SCOPE("NtFlushDisplayBufferPPM");
+	NtResolveFastClear(display);
 
 	// Write the PPM header
 	fprintf(outfile, "P3\n%d %d\n%d\n", display->xRes, display->yRes, 5333);
@@ -380,19 +1411,207 @@ int NtFlushDisplayBufferPPM(FILE* outfile, NtDisplay* display)
 	return NT_SUCCESS;
 }
 
-// Callback function for stb_image_write to write to FILE*
-void write_func(void* context, void* data, int size) {
-	fwrite(data, 1, size, (FILE*)context);
-}
-
-/*Renderer*/
-
 /// <summary>
-/// Creates a new render, display must be already initialized here.
-/// We grab params from display (ie. xRes, yRes)
+/// Reads an ASCII (P3) or binary (P6) PPM of any max value, which covers flushed frames and the PPM textures
 /// </summary>
-/// <param name="render"></param>
-/// <param name="display"></param>
+/// <param name="path"></param>
+/// <param name="image"></param>
+/// <returns></returns>
+int NtReadImagePPM(const std::string& path, NtImage& image) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		NtLog(std::cerr, "NtReadImagePPM: Error opening file " + path + "\n");
+		return NT_FAILURE;
+	}
+	//Header fields are whitespace separated and may be interleaved with # comments
+	auto readField = [&file](int& value) {
+		file >> std::ws;
+		while (file.peek() == '#') {
+			std::string comment;
+			std::getline(file, comment);
+			file >> std::ws;
+		}
+		return static_cast<bool>(file >> value);
+	};
+	std::string magic;
+	file >> magic;
+	int width, height, maxValue;
+	if ((magic != "P3" && magic != "P6") || !readField(width) || !readField(height) || !readField(maxValue) ||
+		width <= 0 || height <= 0 || maxValue <= 0 || maxValue > 65535) {
+		NtLog(std::cerr, "NtReadImagePPM: Unsupported or invalid header in " + path + "\n");
+		return NT_FAILURE;
+	}
+
+	size_t pixelCount = (size_t)width * height;
+	std::vector<NtPixel> pixels(pixelCount);
+	if (magic == "P3") {
+		for (NtPixel& pixel : pixels) {
+			int r, g, b;
+			if (!(file >> r >> g >> b)) {
+				NtLog(std::cerr, "NtReadImagePPM: Truncated pixel data in " + path + "\n");
+				return NT_FAILURE;
+			}
+			pixel = { (unsigned short)r, (unsigned short)g, (unsigned short)b, 0 };
+		}
+	}
+	else {
+		//A single whitespace byte separates the header from the samples, 16 bit samples are big endian
+		file.get();
+		int sampleBytes = maxValue < 256 ? 1 : 2;
+		std::vector<unsigned char> data(pixelCount * 3 * sampleBytes);
+		if (!file.read((char*)data.data(), data.size())) {
+			NtLog(std::cerr, "NtReadImagePPM: Truncated pixel data in " + path + "\n");
+			return NT_FAILURE;
+		}
+		for (size_t i = 0; i < pixelCount; i++) {
+			unsigned short channels[3];
+			for (int c = 0; c < 3; c++) {
+				const unsigned char* sample = &data[(i * 3 + c) * sampleBytes];
+				channels[c] = sampleBytes == 1 ? sample[0] : (unsigned short)((sample[0] << 8) | sample[1]);
+			}
+			pixels[i] = { channels[0], channels[1], channels[2], 0 };
+		}
+	}
+	image.width = width;
+	image.height = height;
+	image.maxValue = maxValue;
+	image.pixels.swap(pixels);
+	return NT_SUCCESS;
+}
+
+/// <summary>
+/// Writes a binary (P6) PPM, with 16 bit samples when the max value needs them
+/// </summary>
+/// <param name="path"></param>
+/// <param name="image"></param>
+/// <returns></returns>
+int NtWriteImagePPM(const std::string& path, const NtImage& image) {
+	if (image.width <= 0 || image.height <= 0 || image.maxValue <= 0 || image.maxValue > 65535 ||
+		image.pixels.size() != (size_t)image.width * image.height) return NT_FAILURE;
+	std::ofstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		NtLog(std::cerr, "NtWriteImagePPM: Error opening file " + path + "\n");
+		return NT_FAILURE;
+	}
+	file << "P6\n" << image.width << " " << image.height << "\n" << image.maxValue << "\n";
+	int sampleBytes = image.maxValue < 256 ? 1 : 2;
+	std::vector<unsigned char> data(image.pixels.size() * 3 * sampleBytes);
+	for (size_t i = 0; i < image.pixels.size(); i++) {
+		const unsigned short channels[3] = { image.pixels[i].r, image.pixels[i].g, image.pixels[i].b };
+		for (int c = 0; c < 3; c++) {
+			unsigned short value = std::min<unsigned short>(channels[c], image.maxValue);
+			unsigned char* sample = &data[(i * 3 + c) * sampleBytes];
+			if (sampleBytes == 1) sample[0] = (unsigned char)value;
+			else sample[0] = (unsigned char)(value >> 8), sample[1] = (unsigned char)value;
+		}
+	}
+	file.write((const char*)data.data(), data.size());
+	return file ? NT_SUCCESS : NT_FAILURE;
+}
+
+/// <summary>
+/// Compares two images of the same size, channel values are normalized by each image's max value first.
+/// The optional diff image is 8 bit: the reference's luma dimmed to a quarter, with differences amplified 16x in red.
+/// </summary>
+/// <param name="reference"></param>
+/// <param name="candidate"></param>
+/// <param name="difference"></param>
+/// <param name="diffImage"></param>
+/// <returns>NT_FAILURE when the sizes differ</returns>
+int NtCompareImages(const NtImage& reference, const NtImage& candidate, NtImageDifference& difference, NtImage* diffImage) {
+	if (reference.width != candidate.width || reference.height != candidate.height || reference.width <= 0 || reference.height <= 0 ||
+		reference.pixels.size() != (size_t)reference.width * reference.height || candidate.pixels.size() != reference.pixels.size()) {
+		NtLog(std::cerr, "NtCompareImages: Image sizes differ\n");
+		return NT_FAILURE;
+	}
+	int width = reference.width;
+	int height = reference.height;
+	size_t pixelCount = reference.pixels.size();
+	float referenceScale = 1.0f / reference.maxValue;
+	float candidateScale = 1.0f / candidate.maxValue;
+	std::vector<float> referenceLuma(pixelCount), candidateLuma(pixelCount);
+	if (diffImage != nullptr) {
+		diffImage->width = width;
+		diffImage->height = height;
+		diffImage->maxValue = 255;
+		diffImage->pixels.assign(pixelCount, { 0, 0, 0, 0 });
+	}
+
+	difference = NtImageDifference();
+	double squaredError = 0;
+	for (size_t i = 0; i < pixelCount; i++) {
+		const NtPixel& a = reference.pixels[i];
+		const NtPixel& b = candidate.pixels[i];
+		float ar = a.r * referenceScale, ag = a.g * referenceScale, ab = a.b * referenceScale;
+		float br = b.r * candidateScale, bg = b.g * candidateScale, bb = b.b * candidateScale;
+		float pixelError = std::max({ std::fabs(ar - br), std::fabs(ag - bg), std::fabs(ab - bb) });
+		squaredError += (ar - br) * (ar - br) + (ag - bg) * (ag - bg) + (ab - bb) * (ab - bb);
+		difference.maxAbsError = std::max(difference.maxAbsError, (double)pixelError);
+		difference.differingPixels += pixelError > 0;
+		referenceLuma[i] = 0.299f * ar + 0.587f * ag + 0.114f * ab;
+		candidateLuma[i] = 0.299f * br + 0.587f * bg + 0.114f * bb;
+		if (diffImage != nullptr) {
+			unsigned short context = (unsigned short)(ClipInt((int)(referenceLuma[i] * 255), 0, 255) / 4);
+			unsigned short red = (unsigned short)std::min(255.0f, context + pixelError * 16 * 255);
+			diffImage->pixels[i] = { red, context, context, 0 };
+		}
+	}
+	double meanSquaredError = squaredError / (pixelCount * 3.0);
+	difference.psnr = meanSquaredError > 0 ? 10 * std::log10(1 / meanSquaredError) : INFINITY;
+
+	//SSIM of luma with the usual constants for a dynamic range of 1
+	const int window = 8, stride = 4;
+	const double c1 = 0.01 * 0.01, c2 = 0.03 * 0.03;
+	double ssimSum = 0;
+	int windowCount = 0;
+	for (int y0 = 0; y0 + window <= height; y0 += stride) {
+		for (int x0 = 0; x0 + window <= width; x0 += stride) {
+			double sumA = 0, sumB = 0, sumAA = 0, sumBB = 0, sumAB = 0;
+			for (int y = y0; y < y0 + window; y++) {
+				for (int x = x0; x < x0 + window; x++) {
+					double a = referenceLuma[x + y * width], b = candidateLuma[x + y * width];
+					sumA += a;
+					sumB += b;
+					sumAA += a * a;
+					sumBB += b * b;
+					sumAB += a * b;
+				}
+			}
+			double n = window * window;
+			double meanA = sumA / n, meanB = sumB / n;
+			double varianceA = sumAA / n - meanA * meanA, varianceB = sumBB / n - meanB * meanB;
+			double covariance = sumAB / n - meanA * meanB;
+			ssimSum += ((2 * meanA * meanB + c1) * (2 * covariance + c2)) / ((meanA * meanA + meanB * meanB + c1) * (varianceA + varianceB + c2));
+			windowCount++;
+		}
+	}
+	difference.ssim = windowCount > 0 ? ssimSum / windowCount : 1;
+	return NT_SUCCESS;
+}
+
+/// <summary>
+/// True when every metric of the difference is within the tolerance
+/// </summary>
+/// <param name="difference"></param>
+/// <param name="tolerance"></param>
+/// <returns></returns>
+bool NtImageWithinTolerance(const NtImageDifference& difference, const NtImageTolerance& tolerance) {
+	return difference.maxAbsError <= tolerance.maxAbsError && difference.psnr >= tolerance.minPSNR && difference.ssim >= tolerance.minSSIM;
+}
+
+// Callback function for stb_image_write to write to FILE*
+void write_func(void* context, void* data, int size) {
+	fwrite(data, 1, size, (FILE*)context);
+}
+
+/*Renderer*/
+
+/// <summary>
+/// Creates a new render, display must be already initialized here.
+/// We grab params from display (ie. xRes, yRes)
+/// </summary>
+/// <param name="render"></param>
+/// <param name="display"></param>
 /// <returns></returns>
 int NtNewRender(NtRender** render, NtDisplay* display, int sampleRenderNum) {
 	if (display == nullptr) return NT_FAILURE;
@@ -400,21 +1619,20 @@ int NtNewRender(NtRender** render, NtDisplay* display, int sampleRenderNum) {
 	(*render)->display = display;
 	(*render)->zBuffer = new float* [display->xRes + 1];
 	(*render)->sampleRenderNum = sampleRenderNum;
+	(*render)->idBuffer = nullptr;
 	if (!(*render)->zBuffer) {
 		delete render;
 		return NT_FAILURE;
 	}
 
-	for (int i = 0; i <= display->xRes; i++) {
-		(*render)->zBuffer[i] = new float[display->yRes + 1];
-
-		// Initialize Z-buffer to infinity
-		for (int j = 0; j <= display->yRes; j++) {
-			(*render)->zBuffer[i][j] = INFINITY;
-		}
+	//Columns are indexed zBuffer[x][y] but share one contiguous block so clearing is a single fill
+	int columnSize = display->yRes + 1;
+	(*render)->zBuffer[0] = new float[(display->xRes + 1) * columnSize];
+	for (int i = 1; i <= display->xRes; i++) {
+		(*render)->zBuffer[i] = (*render)->zBuffer[0] + i * columnSize;
 	}
 	NtLoadIdentityMatrix((*render)->worldMatrix);
-	return NT_SUCCESS;
+	return NtClearRender(*render);
 }
 
 /// <summary>
@@ -423,35 +1641,126 @@ int NtNewRender(NtRender** render, NtDisplay* display, int sampleRenderNum) {
 /// <param name="render"></param>
 /// <returns></returns>
 int NtFreeRender(NtRender* render) {
+	if (render == nullptr) return NT_FAILURE;
 	//Free zbuffer
-	for (int i = 0; i < render->display->xRes; i++) {
-		delete[] render->zBuffer[i];
-	}
+	delete[] render->zBuffer[0];
 	delete[] render->zBuffer;
+	delete[] render->idBuffer;
 	delete render;
 	return NT_SUCCESS;
 }
 
 /// <summary>
-/// Process a single triangle with z-buffer
+/// Resets per frame render state: z-buffer to infinity, id buffer to background and primitive count, no allocation
+/// </summary>
+/// <param name="render"></param>
+/// <returns></returns>
+int NtClearRender(NtRender* render) {
+	if (render == nullptr || render->display == nullptr) return NT_FAILURE;
+	size_t zBufferSize = static_cast<size_t>(render->display->xRes + 1) * (render->display->yRes + 1);
+	float infinity = INFINITY;
+	unsigned int infinityBits;
+	std::memcpy(&infinityBits, &infinity, sizeof(infinityBits));
+	NtFill32(render->zBuffer[0], infinityBits, zBufferSize);
+	if (render->idBuffer != nullptr) {
+		size_t bufferSize = static_cast<size_t>(render->display->xRes) * render->display->yRes;
+		NtFill32(render->idBuffer, 0xFFFFFFFFu, bufferSize);
+	}
+	render->primitiveCount = 0;
+	render->edgeMask = nullptr;
+	render->matrixStack.clear();
+	return NT_SUCCESS;
+}
+
+/// <summary>
+/// Allocates the render's primitive id buffer if it has none and clears it to background (-1)
+/// </summary>
+/// <param name="render"></param>
+/// <returns></returns>
+int NtNewIdBuffer(NtRender* render) {
+	if (render == nullptr || render->display == nullptr) return NT_FAILURE;
+	int bufferSize = render->display->xRes * render->display->yRes;
+	if (render->idBuffer == nullptr) {
+		render->idBuffer = new int[bufferSize];
+	}
+	std::fill(render->idBuffer, render->idBuffer + bufferSize, -1);
+	return NT_SUCCESS;
+}
+
+/// <summary>
+/// Spreads one triangle's time over the heatmap tiles it tested pixels in, by pixel count, and clears the scratch counts.
+/// A triangle that tested none is charged to the tile holding its bounding box corner.
+/// </summary>
+static void NtHeatmapChargeTriangle(NtHeatmap& heatmap, int xMin, int yMin, int xMax, int yMax, double seconds) {
+	int tileXMin = ClipInt(xMin, 0, heatmap.xRes - 1) / NT_HEATMAP_TILE_SIZE;
+	int tileYMin = ClipInt(yMin, 0, heatmap.yRes - 1) / NT_HEATMAP_TILE_SIZE;
+	int tileXMax = ClipInt(xMax, 0, heatmap.xRes - 1) / NT_HEATMAP_TILE_SIZE;
+	int tileYMax = ClipInt(yMax, 0, heatmap.yRes - 1) / NT_HEATMAP_TILE_SIZE;
+	unsigned long long tested = 0;
+	for (int tileY = tileYMin; tileY <= tileYMax; tileY++) {
+		for (int tileX = tileXMin; tileX <= tileXMax; tileX++) {
+			tested += heatmap.tileScratch[tileX + tileY * heatmap.tileCountX];
+		}
+	}
+	double nanoseconds = seconds * 1e9;
+	if (tested == 0) {
+		heatmap.tileNanoseconds[tileXMin + tileYMin * heatmap.tileCountX] += nanoseconds;
+		return;
+	}
+	for (int tileY = tileYMin; tileY <= tileYMax; tileY++) {
+		for (int tileX = tileXMin; tileX <= tileXMax; tileX++) {
+			unsigned int& count = heatmap.tileScratch[tileX + tileY * heatmap.tileCountX];
+			heatmap.tileNanoseconds[tileX + tileY * heatmap.tileCountX] += nanoseconds * count / tested;
+			count = 0;
+		}
+	}
+}
+
+/// <summary>
+/// Process a single triangle with z-buffer. Every per pixel decision is a template parameter so each
+/// combination compiles to its own loop: shading mode, texturing, the adaptive anti-aliasing edge mask,
+/// the depth test and heatmap counting. Without the depth test every covered pixel is drawn, depth is still written.
+/// With a clipList the vertices arrive already projected and normalList in camera space, vertexList is only written.
 /// </summary>
 /// <param name="render"></param>
 /// <param name="vertexList"></param>
 /// <param name="normalList"></param>
 /// <param name="color"></param>
+/// <param name="clipList">Optional, clip space positions that replace the object space transform</param>
 /// <returns></returns>
-int NtPutTriangle(NtRender* render, Vector3 vertexList[], Vector3 normalList[], Vector2 uvList[], const NtMaterial& material) {
-	if (render == nullptr) return NT_FAILURE;
+template<NT_SHADING_MODE Shading, bool Textured, bool EdgeMasked, bool DepthTest, bool Heatmap>
+static int NtRasterizeTriangle(NtRender* render, Vector3 vertexList[], Vector3 normalList[], Vector2 uvList[], const NtMaterial& material, const Vector4 clipList[]) {
+	int primitiveId = render->primitiveCount++;
+	const NtAAEdgeMask* edgeMask = render->edgeMask;
+	NtHeatmap* heatmap = render->heatmap;
+	double heatmapStart = Heatmap ? NtStatsSeconds() : 0;
+	NT_STATS(NtRenderStats* stats = render->stats);
+	NT_STATS(bool timed = stats != nullptr && primitiveId % NT_STATS_TIMING_INTERVAL == 0);
+	NT_STATS(double timeStart = timed ? NtStatsSeconds() : 0, timeShade = 0, shadeSeconds = 0);
+	NT_STATS(double clockSeconds = timed ? NtStatsClockSeconds() : 0);
+	NT_STATS(unsigned long long pixelsTested = 0, depthPasses = 0, samplesCovered = 0);
+	NT_STATS(if (stats != nullptr) stats->trianglesSubmitted++);
 
 	//Transform vertex and normals
 	for (int i = 0; i < 3; i++) {
-		Vector4 vec4(vertexList[i].x, vertexList[i].y, vertexList[i].z, 1);
-		Vector4 vec4Normal(normalList[i].x, normalList[i].y, normalList[i].z, 0);
-		Vector4 worldResult = vec4 * render->worldMatrix;
-		Vector4 worldResultNormal = vec4Normal * render->worldMatrixInverseTransposed;
-		Vector4 camResult = worldResult * render->camera->viewMatrix;
-		Vector4 camResultNormal = worldResultNormal * render->camera->viewMatrix;
-		Vector4 ndcResult = camResult * render->camera->projectMatrix;
+		Vector4 ndcResult;
+		if (clipList == nullptr) {
+			Vector4 vec4(vertexList[i].x, vertexList[i].y, vertexList[i].z, 1);
+			Vector4 vec4Normal(normalList[i].x, normalList[i].y, normalList[i].z, 0);
+			Vector4 worldResult = vec4 * render->worldMatrix;
+			Vector4 worldResultNormal = vec4Normal * render->worldMatrixInverseTransposed;
+			Vector4 camResult = worldResult * render->camera->viewMatrix;
+			Vector4 camResultNormal = worldResultNormal * render->camera->viewMatrix;
+			ndcResult = camResult * render->camera->projectMatrix;
+
+			//Write normal result back
+			normalList[i].x = camResultNormal.x;
+			normalList[i].y = camResultNormal.y;
+			normalList[i].z = camResultNormal.z;
+		}
+		else {
+			ndcResult = clipList[i];
+		}
 		//Write result back to vector3 
 		vertexList[i].x = ndcResult.x / ndcResult.w;
 		vertexList[i].y = ndcResult.y / ndcResult.w;
@@ -461,10 +1770,12 @@ int NtPutTriangle(NtRender* render, Vector3 vertexList[], Vector3 normalList[],
 		vertexList[i].x = (vertexList[i].x + 1) * ((render->display->xRes - 1) / 2);
 		vertexList[i].y = (1 - vertexList[i].y) * ((render->display->yRes - 1) / 2);
 
-		//Write normal result back
-		normalList[i].x = camResultNormal.x;
-		normalList[i].y = camResultNormal.y;
-		normalList[i].z = camResultNormal.z;
+		//Sample renders shift the triangle by their sub-pixel offset so pixel centers sample the jittered location
+		if (render->sampleRenderNum >= 0) {
+			const NtAAShift& aaShift = render->display->aaShifts[render->sampleRenderNum];
+			vertexList[i].x -= aaShift.shiftX;
+			vertexList[i].y -= aaShift.shiftY;
+		}
 		normalList[i].normalize();
 	}
 
@@ -492,32 +1803,55 @@ int NtPutTriangle(NtRender* render, Vector3 vertexList[], Vector3 normalList[],
 	int xMax = std::ceil(xMaxf);
 	int yMax = std::ceil(yMaxf);
 
+	//Zero area after clipping covers no pixel center, this includes triangles entirely off one screen edge
+	Vector3 v0 = vertexList[0];
+	Vector3 v1 = vertexList[1];
+	Vector3 v2 = vertexList[2];
+	float f12 = NTMath::f12(v0.x, v0.y, v1, v2);
+	NT_STATS(double timeTransformed = timed ? NtStatsSeconds() : 0);
+	NT_STATS(if (timed) stats->stageSeconds[NT_STAGE_TRANSFORM] += timeTransformed - timeStart, stats->timedTriangles++);
+	if (f12 == 0) {
+		NT_STATS(if (stats != nullptr) stats->trianglesCulled++);
+		if constexpr (Heatmap) NtHeatmapChargeTriangle(*heatmap, xMin, yMin, xMax, yMax, NtStatsSeconds() - heatmapStart);
+		return NT_SUCCESS;
+	}
+
 	//Lighting pre-compute for flat and gouraud
 	//Compute Color - Shading
-	Vector3 finalColor;
+	Vector3 flatColor;
 	Vector3 vertexColors[3];
-	switch (render->shadingMode) {
-	case NT_SHADE_FLAT:
-		finalColor = NtLightingPhong(material, NtAverageQuadNormals(normalList), render->directionalLight, render->camera->viewDirection, render->ambientLight);
-		break;
-
-	case NT_SHADE_GOURAUD:
+	if constexpr (Shading == NT_SHADE_FLAT) {
+		flatColor = NtLightingPhong(material, NtAverageQuadNormals(normalList), render->directionalLight, render->camera->viewDirection, render->ambientLight);
+	}
+	else if constexpr (Shading == NT_SHADE_GOURAUD) {
 		for (int i = 0; i < 3; i++) {
 			vertexColors[i] = NtLightingPhong(material, normalList[i], render->directionalLight, render->camera->viewDirection, render->ambientLight);
 		}
-		break;
 	}
-	//Rasterization
-	for (int y = yMin; y <= yMax; y++) {
-		for (int x = xMin; x <= xMax; x++) {
-			Vector3 v0 = vertexList[0];
-			Vector3 v1 = vertexList[1];
-			Vector3 v2 = vertexList[2];
 
-			float f12 = NTMath::f12(v0.x, v0.y, v1, v2);
-			float f20 = NTMath::f20(v1.x, v1.y, v2, v0);
-			float f01 = NTMath::f01(v2.x, v2.y, v0, v1);
+	NtTextureSetup textureSetup;
+	if constexpr (Textured) {
+		NtSetupTexture(textureSetup, uvList, vertexList);
+	}
 
+	//Rasterization
+	NT_STATS(double timeRaster = timed ? NtStatsSeconds() : 0);
+	NT_STATS(if (timed) shadeSeconds = timeRaster - timeTransformed);
+	float f20 = NTMath::f20(v1.x, v1.y, v2, v0);
+	float f01 = NTMath::f01(v2.x, v2.y, v0, v1);
+	for (int y = yMin; y <= yMax; y++) {
+		int rowXMin = xMin;
+		int rowXMax = xMax;
+		//Adaptive anti-aliasing, only walk the span of edge pixels on this row
+		if constexpr (EdgeMasked) {
+			if (y >= render->display->yRes) break;
+			rowXMin = std::max(rowXMin, edgeMask->rowMin[y]);
+			rowXMax = std::min(rowXMax, edgeMask->rowMax[y]);
+		}
+		for (int x = rowXMin; x <= rowXMax; x++) {
+			if constexpr (EdgeMasked) {
+				if (!edgeMask->mask[x + y * render->display->xRes]) continue;
+			}
 			float alpha = NTMath::f12(x, y, v1, v2) / f12;
 			float beta = NTMath::f20(x, y, v2, v0) / f20;
 			float gamma = NTMath::f01(x, y, v0, v1) / f01;
@@ -525,25 +1859,92 @@ int NtPutTriangle(NtRender* render, Vector3 vertexList[], Vector3 normalList[],
 				//Z-Buffer to determine if current pixel should be put
 				//Interpolate z from alpha beta gamma
 				float currZ = alpha * v0.z + beta * v1.z + gamma * v2.z;
-				if (currZ < render->zBuffer[x][y]) {
+				NT_STATS(pixelsTested++);
+				if constexpr (Heatmap) {
+					if (x < heatmap->xRes && y < heatmap->yRes) {
+						bool passes = !DepthTest || currZ < render->zBuffer[x][y];
+						(passes ? heatmap->fragments : heatmap->rejects)[x + y * heatmap->xRes]++;
+						heatmap->tileScratch[x / NT_HEATMAP_TILE_SIZE + (y / NT_HEATMAP_TILE_SIZE) * heatmap->tileCountX]++;
+					}
+				}
+				if (!DepthTest || currZ < render->zBuffer[x][y]) {
+					NT_STATS(depthPasses++);
+					NT_STATS(samplesCovered += render->zBuffer[x][y] == INFINITY);
+					NT_STATS(if (timed) timeShade = NtStatsSeconds());
 					// Update the Z-buffer
 					render->zBuffer[x][y] = currZ;
+					if (render->idBuffer != nullptr && x < render->display->xRes && y < render->display->yRes) {
+						render->idBuffer[x + y * render->display->xRes] = primitiveId;
+					}
 
 					//Compute Color - Phong (interpolate normals and light compute per pixel)
-					if (render->shadingMode == NT_SHADE_PHONG) {
+					Vector3 finalColor;
+					if constexpr (Shading == NT_SHADE_PHONG) {
 						Vector3 interpolatedNormal = NtInterpolateVector3(normalList, alpha, beta, gamma, true);
 						finalColor = NtLightingPhong(material, interpolatedNormal, render->directionalLight, render->camera->viewDirection, render->ambientLight);
 					}
-					else if (render->shadingMode == NT_SHADE_GOURAUD) {
+					else if constexpr (Shading == NT_SHADE_GOURAUD) {
 						finalColor = NtInterpolateVector3(vertexColors, alpha, beta, gamma, false);
 					}
+					else {
+						finalColor = flatColor;
+					}
 
-					NtTexturePixel(finalColor, material, uvList, vertexList, alpha, beta, gamma);
+					if constexpr (Textured) {
+						NtTexturePixel(finalColor, material, textureSetup, x, y);
+					}
 					NtPutDisplay(render->display, x, y, NTMath::fts(finalColor.x), NTMath::fts(finalColor.y), NTMath::fts(finalColor.z), 255, render->sampleRenderNum);
+					NT_STATS(if (timed) shadeSeconds += NtStatsSeconds() - timeShade - clockSeconds);
 				}
 			}
 		}
 	}
+	if constexpr (Heatmap) NtHeatmapChargeTriangle(*heatmap, xMin, yMin, xMax, yMax, NtStatsSeconds() - heatmapStart);
+#if NT_RENDER_STATS
+	if (stats != nullptr) {
+		stats->trianglesRasterized++;
+		stats->pixelsTested += pixelsTested;
+		stats->depthPasses += depthPasses;
+		stats->fragmentsShaded += depthPasses;
+		if constexpr (Textured) stats->textureFetches += depthPasses;
+		stats->samplesCovered += samplesCovered;
+		if (timed) {
+			stats->stageSeconds[NT_STAGE_SHADE] += shadeSeconds;
+			//Both clock reads around every fragment are part of the loop time but belong to neither stage
+			double rasterSeconds = NtStatsSeconds() - timeTransformed - shadeSeconds - 2 * clockSeconds * depthPasses;
+			stats->stageSeconds[NT_STAGE_RASTER] += std::max(rasterSeconds, 0.0);
+		}
+	}
+#endif
+	return NT_SUCCESS;
+}
+
+typedef int (*NtRasterizeFunction)(NtRender* render, Vector3 vertexList[], Vector3 normalList[], Vector2 uvList[], const NtMaterial& material, const Vector4 clipList[]);
+#define NT_RASTERIZE_HEATMAP(shading, textured, edgeMasked, depthTest) { NtRasterizeTriangle<shading, textured, edgeMasked, depthTest, false>, NtRasterizeTriangle<shading, textured, edgeMasked, depthTest, true> }
+#define NT_RASTERIZE_DEPTH(shading, textured, edgeMasked) { NT_RASTERIZE_HEATMAP(shading, textured, edgeMasked, false), NT_RASTERIZE_HEATMAP(shading, textured, edgeMasked, true) }
+#define NT_RASTERIZE_MASK(shading, textured) { NT_RASTERIZE_DEPTH(shading, textured, false), NT_RASTERIZE_DEPTH(shading, textured, true) }
+#define NT_RASTERIZE_SHADING(shading) { NT_RASTERIZE_MASK(shading, false), NT_RASTERIZE_MASK(shading, true) }
+
+//Indexed [shading mode][textured][edge masked][depth test][heatmap], rows follow the NT_SHADING_MODE values
+static const NtRasterizeFunction ntRasterizeFunctions[3][2][2][2][2] = {
+	NT_RASTERIZE_SHADING(NT_SHADE_FLAT),
+	NT_RASTERIZE_SHADING(NT_SHADE_PHONG),
+	NT_RASTERIZE_SHADING(NT_SHADE_GOURAUD)
+};
+
+/// <summary>
+/// Process a single triangle with z-buffer, the rasterizer variant is picked once from the render state and material
+/// </summary>
+/// <param name="render"></param>
+/// <param name="vertexList"></param>
+/// <param name="normalList"></param>
+/// <param name="uvList"></param>
+/// <param name="material"></param>
+/// <returns></returns>
+int NtPutTriangle(NtRender* render, Vector3 vertexList[], Vector3 normalList[], Vector2 uvList[], const NtMaterial& material) {
+	if (render == nullptr || render->shadingMode < NT_SHADE_FLAT || render->shadingMode > NT_SHADE_GOURAUD) return NT_FAILURE;
+	NtRasterizeFunction rasterize = ntRasterizeFunctions[render->shadingMode][material.texture != nullptr][render->edgeMask != nullptr][render->depthTest][render->heatmap != nullptr];
+	return rasterize(render, vertexList, normalList, uvList, material, nullptr);
 }
 
 int NtPutTriangle(NtRender* render, NtTriangle& triangle, const NtMaterial& material) {
@@ -565,6 +1966,23 @@ int NtPutTriangle(NtRender* render, NtTriangle& triangle, const NtMaterial& mate
 
 	return NtPutTriangle(render, vertexList, normalList, uvList, material);
 }
+
+/// <summary>
+/// Process a triangle that was already transformed, positions in clip space and normals in camera space.
+/// The render's world matrix is ignored, this is how instanced shapes submit their batch transformed vertices.
+/// </summary>
+/// <param name="render"></param>
+/// <param name="clipList"></param>
+/// <param name="normalList">Normalized in place</param>
+/// <param name="uvList"></param>
+/// <param name="material"></param>
+/// <returns></returns>
+int NtPutTransformedTriangle(NtRender* render, const Vector4 clipList[], Vector3 normalList[], Vector2 uvList[], const NtMaterial& material) {
+	if (render == nullptr || render->shadingMode < NT_SHADE_FLAT || render->shadingMode > NT_SHADE_GOURAUD) return NT_FAILURE;
+	NtRasterizeFunction rasterize = ntRasterizeFunctions[render->shadingMode][material.texture != nullptr][render->edgeMask != nullptr][render->depthTest][render->heatmap != nullptr];
+	Vector3 vertexList[3];
+	return rasterize(render, vertexList, normalList, uvList, material, clipList);
+}
 //////Transormations//////
 
 /// <summary>
@@ -807,16 +2225,130 @@ int NtCalculateProjectionMatrix(NtCamera& camera, float near, float far, float t
 ///////Scene///////
 
 /// <summary>
-/// Loads a scene description in JSON format to current scene. If autoLoadMeshAndTexture = false, user must manually specify to load mesh and textures.
+/// Reads a transforms array laid out as [rotation {Rx, Ry, Rz}, {S}, {T}] into transformation
+/// </summary>
+/// <param name="transforms"></param>
+/// <param name="transformation"></param>
+static void NtParseTransforms(const nlohmann::json& transforms, NtTransformation& transformation) {
+	transformation.scale.x = transforms[1]["S"][0];
+	transformation.scale.y = transforms[1]["S"][1];
+	transformation.scale.z = transforms[1]["S"][2];
+
+	//Write rotations
+	if (transforms[0].find("Ry") != transforms[0].end()) {
+		transformation.rotation.y = transforms[0]["Ry"];
+	}
+	if (transforms[0].find("Rx") != transforms[0].end()) {
+		transformation.rotation.x = transforms[0]["Rx"];
+	}
+	if (transforms[0].find("Rz") != transforms[0].end()) {
+		transformation.rotation.z = transforms[0]["Rz"];
+	}
+
+	transformation.translation.x = transforms[2]["T"][0];
+	transformation.translation.y = transforms[2]["T"][1];
+	transformation.translation.z = transforms[2]["T"][2];
+}
+
+/// <summary>
+/// Parses an instance's "material" JSON block, keys that are not present keep the shape's value
+/// </summary>
+/// <param name="materialValue"></param>
+/// <param name="material"></param>
+static void NtParseMaterialOverrides(const nlohmann::json& materialValue, NtMaterial& material) {
+	if (materialValue.find("Cs") != materialValue.end()) {
+		material.surfaceColor = Vector3(materialValue["Cs"][0], materialValue["Cs"][1], materialValue["Cs"][2]);
+	}
+	material.Ka = materialValue.value("Ka", material.Ka);
+	material.Kd = materialValue.value("Kd", material.Kd);
+	material.Ks = materialValue.value("Ks", material.Ks);
+	material.Kt = materialValue.value("Kt", material.Kt);
+	material.specularExponent = materialValue.value("n", material.specularExponent);
+	material.textureId = materialValue.value("texture", material.textureId);
+}
+
+/// <summary>
+/// Parses an "antialiasing" JSON block, keys that are not present keep their current value
+/// </summary>
+/// <param name="aaValue"></param>
+/// <param name="aa"></param>
+static void NtParseAASettings(const nlohmann::json& aaValue, NtAASettings& aa) {
+	if (aaValue.find("samples") != aaValue.end()) {
+		aa.sampleCount = aaValue["samples"];
+	}
+	if (aaValue.find("pattern") != aaValue.end()) {
+		std::string patternStr = aaValue["pattern"];
+		if (patternStr == "legacy") aa.pattern = NT_AA_PATTERN_LEGACY;
+		else if (patternStr == "rotated-grid") aa.pattern = NT_AA_PATTERN_ROTATED_GRID;
+		else if (patternStr == "poisson") aa.pattern = NT_AA_PATTERN_POISSON;
+		else NtLog(std::cerr, "Unknown anti-aliasing pattern " + patternStr + "\n");
+	}
+	if (aaValue.find("filter") != aaValue.end()) {
+		std::string filterStr = aaValue["filter"];
+		if (filterStr == "box") aa.filter = NT_AA_FILTER_BOX;
+		else if (filterStr == "tent") aa.filter = NT_AA_FILTER_TENT;
+		else if (filterStr == "gaussian") aa.filter = NT_AA_FILTER_GAUSSIAN;
+		else NtLog(std::cerr, "Unknown anti-aliasing filter " + filterStr + "\n");
+	}
+	if (aaValue.find("mode") != aaValue.end()) {
+		std::string modeStr = aaValue["mode"];
+		if (modeStr == "supersample") aa.mode = NT_AA_SUPERSAMPLE;
+		else if (modeStr == "adaptive") aa.mode = NT_AA_ADAPTIVE;
+		else if (modeStr == "fxaa") aa.mode = NT_AA_FXAA;
+		else NtLog(std::cerr, "Unknown anti-aliasing mode " + modeStr + "\n");
+	}
+	if (aaValue.find("edgeDepthThreshold") != aaValue.end()) {
+		aa.edgeDepthThreshold = aaValue["edgeDepthThreshold"];
+	}
+	if (aaValue.find("edgeColorThreshold") != aaValue.end()) {
+		aa.edgeColorThreshold = aaValue["edgeColorThreshold"];
+	}
+	if (aaValue.find("fxaaEdgeThreshold") != aaValue.end()) {
+		aa.fxaaEdgeThreshold = aaValue["fxaaEdgeThreshold"];
+	}
+	if (aaValue.find("fxaaEdgeThresholdMin") != aaValue.end()) {
+		aa.fxaaEdgeThresholdMin = aaValue["fxaaEdgeThresholdMin"];
+	}
+	if (aaValue.find("fxaaSubpixelQuality") != aaValue.end()) {
+		aa.fxaaSubpixelQuality = aaValue["fxaaSubpixelQuality"];
+	}
+	//A non legacy sample count implies the standard pattern unless one was given
+	if (aa.pattern == NT_AA_PATTERN_LEGACY && aa.sampleCount != 6 && aaValue.find("pattern") == aaValue.end()) {
+		aa.pattern = NT_AA_PATTERN_ROTATED_GRID;
+	}
+}
+
+/// <summary>
+/// Parses anti-aliasing settings from JSON text in the same format as a scene's "antialiasing" block
+/// </summary>
+/// <param name="jsonText"></param>
+/// <param name="aaSettings"></param>
+/// <returns></returns>
+int NtParseAASettingsJSON(const std::string& jsonText, NtAASettings& aaSettings) {
+	try {
+		NtParseAASettings(nlohmann::json::parse(jsonText), aaSettings);
+		return NT_SUCCESS;
+	}
+	catch (const std::exception& e) {
+		NtLog(std::cerr, std::string("Error parsing anti-aliasing JSON ") + e.what() + "\n");
+		return NT_FAILURE;
+	}
+}
+
+/// <summary>
+/// Loads a scene description in JSON format to current scene. If autoLoadMeshAndTexture = false, user must manually specify to load mesh and textures,
+/// either per asset or with NtLoadSceneAssets/NtLoadSceneAssetsAsync.
 /// </summary>
 /// <param name="scenePath"></param>
 int NtLoadSceneJSON(std::string scenePath, NtScene* scene, bool autoLoadMeshAndTexture) {
 	using json = nlohmann::json;
 	int status = 0;
+	NT_STATS(double timeStart = NtStatsSeconds());
+	NT_TRACE_SCOPE("NtLoadSceneJSON", scenePath.c_str());
 	std::ifstream file(scenePath); // Assuming the JSON is stored in a file named "scene.json"
 
 	if (!file.is_open()) {
-		std::cerr << "Failed to open JSON file\n";
+		NtLog(std::cerr, "Failed to open JSON file " + scenePath + "\n");
 		return NT_FAILURE;
 	}
 
@@ -826,7 +2358,7 @@ int NtLoadSceneJSON(std::string scenePath, NtScene* scene, bool autoLoadMeshAndT
 		file >> jsonData;
 	}
 	catch (const std::exception& e) {
-		std::cout << "Error parsing JSON" << "\n";
+		NtLog(std::cout, "Error parsing JSON\n");
 		return NT_FAILURE;
 	}
 
@@ -836,7 +2368,7 @@ int NtLoadSceneJSON(std::string scenePath, NtScene* scene, bool autoLoadMeshAndT
 			for (const auto& shapeValue : jsonData["scene"]["shapes"]) {
 				NtShape shape;
 				shape.id = shapeValue["id"];
-				shape.geometryId = shapeValue["geometry"];
+				shape.geometryId = shapeValue.value("geometry", ""); //Optional, a shape without one only groups its children
 				shape.notes = shapeValue["notes"];
 
 				//Write material
@@ -847,39 +2379,54 @@ int NtLoadSceneJSON(std::string scenePath, NtScene* scene, bool autoLoadMeshAndT
 				shape.material.Ka = material["Ka"];
 				shape.material.Kd = material["Kd"];
 				shape.material.Ks = material["Ks"];
-				shape.material.Kt = material["Kt"];
+				shape.material.Kt = material.value("Kt", shape.material.Kt); //Optional, scene.json predates it
 				shape.material.specularExponent = material["n"];
-				shape.material.textureId = material["texture"];
-
-				//Auto load into mesh map
-				if (autoLoadMeshAndTexture) {
-					status |= NtLoadMesh(shape.geometryId, ".json", scene);
-					status |= NtLoadTexture(shape.material, scene);
-				}
+				shape.material.textureId = material.value("texture", ""); //Optional, untextured without it
 
 				//Write transformations
-				const auto& transforms = shapeValue["transforms"];
-				shape.transforms.scale.x = transforms[1]["S"][0];
-				shape.transforms.scale.y = transforms[1]["S"][1];
-				shape.transforms.scale.z = transforms[1]["S"][2];
-
-				//Write rotations
-				if (transforms[0].find("Ry") != transforms[0].end()) {
-					shape.transforms.rotation.y = transforms[0]["Ry"];
-				}
-				if (transforms[0].find("Rx") != transforms[0].end()) {
-					shape.transforms.rotation.x = transforms[0]["Rx"];
-				}
-				if (transforms[0].find("Rz") != transforms[0].end()) {
-					shape.transforms.rotation.z = transforms[0]["Rz"];
+				NtParseTransforms(shapeValue["transforms"], shape.transforms);
+
+				//Write keyframes, each holds a full transforms array
+				if (shapeValue.find("keyframes") != shapeValue.end()) {
+					for (const auto& keyValue : shapeValue["keyframes"]) {
+						NtTransformKeyframe keyframe;
+						keyframe.time = keyValue["time"];
+						NtParseTransforms(keyValue["transforms"], keyframe.transforms);
+						shape.keyframes.push_back(keyframe);
+					}
+					std::sort(shape.keyframes.begin(), shape.keyframes.end(),
+						[](const NtTransformKeyframe& a, const NtTransformKeyframe& b) { return a.time < b.time; });
 				}
 
-				shape.transforms.translation.x = transforms[2]["T"][0];
-				shape.transforms.translation.y = transforms[2]["T"][1];
-				shape.transforms.translation.z = transforms[2]["T"][2];
+				//Write instances, each holds a full transforms array and optionally a material with overrides
+				if (shapeValue.find("instances") != shapeValue.end()) {
+					for (const auto& instanceValue : shapeValue["instances"]) {
+						NtInstance instance;
+						NtParseTransforms(instanceValue["transforms"], instance.transforms);
+						instance.material = shape.material;
+						if (instanceValue.find("material") != instanceValue.end()) {
+							NtParseMaterialOverrides(instanceValue["material"], instance.material);
+						}
+						shape.instances.push_back(instance);
+					}
+				}
 
 				scene->shapes.push_back(shape);
 			}
+
+			//Resolve parents by id, only earlier shapes can be parents so the graph can't cycle
+			for (size_t i = 0; i < scene->shapes.size(); i++) {
+				const auto& shapeValue = jsonData["scene"]["shapes"][i];
+				if (shapeValue.find("parent") == shapeValue.end()) continue;
+				std::string parentId = shapeValue["parent"];
+				for (size_t j = 0; j < i && scene->shapes[i].parent < 0; j++) {
+					if (scene->shapes[j].id == parentId) scene->shapes[i].parent = static_cast<int>(j);
+				}
+				if (scene->shapes[i].parent < 0) {
+					NtLog(std::cout, "Shape " + scene->shapes[i].id + " has parent " + parentId + " which is not an earlier shape\n");
+					return NT_FAILURE;
+				}
+			}
 		}
 
 		// Parse camera
@@ -900,6 +2447,18 @@ int NtLoadSceneJSON(std::string scenePath, NtScene* scene, bool autoLoadMeshAndT
 
 			scene->camera.xRes = cameraValue["resolution"][0];
 			scene->camera.yRes = cameraValue["resolution"][1];
+
+			if (cameraValue.find("keyframes") != cameraValue.end()) {
+				for (const auto& keyValue : cameraValue["keyframes"]) {
+					NtCameraKeyframe keyframe;
+					keyframe.time = keyValue["time"];
+					keyframe.from = Vector3(keyValue["from"][0], keyValue["from"][1], keyValue["from"][2]);
+					keyframe.to = Vector3(keyValue["to"][0], keyValue["to"][1], keyValue["to"][2]);
+					scene->cameraKeyframes.push_back(keyframe);
+				}
+				std::sort(scene->cameraKeyframes.begin(), scene->cameraKeyframes.end(),
+					[](const NtCameraKeyframe& a, const NtCameraKeyframe& b) { return a.time < b.time; });
+			}
 		}
 
 		//Parse lights
@@ -928,15 +2487,108 @@ int NtLoadSceneJSON(std::string scenePath, NtScene* scene, bool autoLoadMeshAndT
 				scene->lights.push_back(light);
 			}
 		}
-		std::cout << "Scene parsing completed!\n";
+
+		//Parse anti-aliasing, optional
+		if (jsonData["scene"].find("antialiasing") != jsonData["scene"].end()) {
+			NtParseAASettings(jsonData["scene"]["antialiasing"], scene->aaSettings);
+		}
+		NtLog(std::cout, "Scene parsing completed!\n");
+		NT_STATS(scene->loadSeconds += NtStatsSeconds() - timeStart);
+
+		//Assets are gathered after parsing so each unique file is loaded once, all of them concurrently
+		if (autoLoadMeshAndTexture) {
+			status |= NtLoadSceneAssets(scene);
+		}
 		return status;
 	}
 	catch (const std::exception& e) {
-		std::cout << "Error parsing JSON " << e.what() << "\n";
+		NtLog(std::cout, std::string("Error parsing JSON ") + e.what() + "\n");
 		return NT_FAILURE;
 	}
 }
 
+/// <summary>
+/// Loads every mesh and texture the scene's shapes reference that is not in its maps yet. Unique files are collected
+/// first and then loaded concurrently, one per core, so the scene loads in about the time of its slowest asset.
+/// </summary>
+/// <param name="scene"></param>
+/// <returns></returns>
+int NtLoadSceneAssets(NtScene* scene) {
+	NT_STATS(double timeStart = NtStatsSeconds());
+	NT_TRACE_SCOPE("NtLoadSceneAssets");
+	std::vector<std::string> meshNames;
+	std::vector<std::string> textureNames;
+	auto addTexture = [&](const std::string& textureId) {
+		if (!textureId.empty() && scene->textureMap.find(textureId) == scene->textureMap.end() &&
+			std::find(textureNames.begin(), textureNames.end(), textureId) == textureNames.end()) {
+			textureNames.push_back(textureId);
+		}
+	};
+	for (const NtShape& shape : scene->shapes) {
+		if (!shape.geometryId.empty() && scene->meshMap.find(shape.geometryId) == scene->meshMap.end() &&
+			std::find(meshNames.begin(), meshNames.end(), shape.geometryId) == meshNames.end()) {
+			meshNames.push_back(shape.geometryId);
+		}
+		addTexture(shape.material.textureId);
+		for (const NtInstance& instance : shape.instances) {
+			addTexture(instance.material.textureId);
+		}
+	}
+
+	int meshCount = (int)meshNames.size();
+	int assetCount = meshCount + (int)textureNames.size();
+	std::vector<NtMesh*> meshes(meshCount, nullptr);
+	std::vector<NtTexture*> textures(textureNames.size(), nullptr);
+	std::vector<int> statuses(assetCount, NT_SUCCESS);
+	NtParallelFor(0, assetCount, [&](int begin, int end) {
+		//Assets already load one per core, parsers running inside them must not fan out again.
+		//A lone asset keeps the parallel parsers.
+		bool wasSerial = ntSerialThread;
+		ntSerialThread = wasSerial || assetCount > 1;
+		for (int i = begin; i < end; i++) {
+			if (i < meshCount) {
+				statuses[i] = NtAcquireMesh(NtResolveMeshPath(meshNames[i]), &meshes[i]);
+			}
+			else {
+				statuses[i] = NtAcquireTexture(textureNames[i - meshCount], &textures[i - meshCount]);
+			}
+		}
+		ntSerialThread = wasSerial;
+	});
+
+	//Maps are only written here, on the calling thread
+	int status = NT_SUCCESS;
+	for (int i = 0; i < assetCount; i++) {
+		status |= statuses[i];
+		if (statuses[i] != NT_SUCCESS) continue;
+		if (i < meshCount) scene->meshMap[meshNames[i]] = meshes[i];
+		else scene->textureMap[textureNames[i - meshCount]] = textures[i - meshCount];
+	}
+	auto bindTexture = [scene](NtMaterial& material) {
+		auto it = scene->textureMap.find(material.textureId);
+		if (it != scene->textureMap.end()) {
+			material.texture = it->second;
+		}
+	};
+	for (NtShape& shape : scene->shapes) {
+		bindTexture(shape.material);
+		for (NtInstance& instance : shape.instances) {
+			bindTexture(instance.material);
+		}
+	}
+	NT_STATS(scene->loadSeconds += NtStatsSeconds() - timeStart);
+	return status;
+}
+
+/// <summary>
+/// Starts NtLoadSceneAssets on a background thread, the scene must not be used until the returned future is ready
+/// </summary>
+/// <param name="scene"></param>
+/// <returns>Future holding the load status</returns>
+std::future<int> NtLoadSceneAssetsAsync(NtScene* scene) {
+	return std::async(std::launch::async, NtLoadSceneAssets, scene);
+}
+
 /// <summary>
 /// Loads a texture into given scene's texture map
 /// </summary>
@@ -947,13 +2599,13 @@ int NtLoadTexture(NtMaterial& material, NtScene* scene) {
 	std::string textureName = material.textureId;
 	auto it = scene->textureMap.find(textureName);
 	if (it != scene->textureMap.end()) {
-		std::cout << "Texture map already contains " << textureName << ". Skipped loading" << std::endl;
+		NtLog(std::cout, "Texture map already contains " + textureName + ". Skipped loading\n");
+		material.texture = it->second;
 		return NT_SUCCESS;
 	}
 
-	NtTexture* texture = new NtTexture(textureName);
-	if (texture->GetHeight() == 0 || texture->GetWidth() == 0) {
-		std::cerr << "Failed to load texture: " << textureName << "\n";
+	NtTexture* texture = nullptr;
+	if (NtAcquireTexture(textureName, &texture) != NT_SUCCESS) {
 		return NT_FAILURE;
 	}
 
@@ -963,101 +2615,1564 @@ int NtLoadTexture(NtMaterial& material, NtScene* scene) {
 }
 
 int NtLoadMesh(const std::string meshName, const std::string meshExtension, NtScene* scene) {
+	NT_TRACE_SCOPE("NtLoadMesh", meshName.c_str());
 	auto it = scene->meshMap.find(meshName);
 	if (it != scene->meshMap.end()) {
-		std::cout << "Mesh map already contains " << meshName << ". Skipped loading" << std::endl;
+		NtLog(std::cout, "Mesh map already contains " + meshName + ". Skipped loading\n");
 		return NT_SUCCESS;
 	}
 
-	std::ifstream file(meshName + meshExtension);
-	if (!file.is_open()) {
-		std::cout << "File with name " << meshName << meshExtension << " could not be found";
+	NtMesh* mesh = nullptr;
+	if (NtAcquireMesh(meshName + meshExtension, &mesh) != NT_SUCCESS) {
 		return NT_FAILURE;
 	}
 
-	nlohmann::json jsonData;
-	file >> jsonData;
-
-	NtMesh* mesh = new NtMesh();
-	for (const auto& item : jsonData["data"]) {
-		NtTriangle triangle;
-		// Parse vertices
-		for (int i = 0; i < 3; ++i) {
-			std::string vertexKey = "v" + std::to_string(i);
-			Vector3 pos = { item[vertexKey]["v"][0], item[vertexKey]["v"][1], item[vertexKey]["v"][2] };
-			Vector3 norm = { item[vertexKey]["n"][0], item[vertexKey]["n"][1], item[vertexKey]["n"][2] };
-			Vector2 tex = { item[vertexKey]["t"][0], item[vertexKey]["t"][1] };
-
-			NtVertex vertex;
-			vertex.vertexPos = pos;
-			vertex.vertexNormal = norm;
-			vertex.texture = tex;
-
-			switch (i) {
-			case 0: triangle.v0 = vertex; break;
-			case 1: triangle.v1 = vertex; break;
-			case 2: triangle.v2 = vertex; break;
-			}
-		}
-
-		mesh->triangles.push_back(triangle);
-	}
-
 	scene->meshMap[meshName] = mesh;
 	return NT_SUCCESS;
 }
 
 /// <summary>
-/// Loads anti-aliasing filter into display, max sample count is 6
-/// </summary>
-/// <param name="display"></param>
-/// <returns></returns>
-int NtLoadAAFilter(NtDisplay* display) {
-	if (display == nullptr) return NT_FAILURE;
-	display->aaShifts[0] = { -0.52, 0.38, 0.128 };
-	display->aaShifts[1] = { 0.41, 0.56, 0.119 };
-	display->aaShifts[2] = { 0.27,  0.08, 0.294 };
-	display->aaShifts[3] = { -0.17, -0.29, 0.249 };
-	display->aaShifts[4] = { 0.58, -0.55, 0.104 };
-	display->aaShifts[5] = { -0.31, -0.71, 0.106 };
-
-	return NT_SUCCESS;
-}
-
-/// <summary>
-/// Renders a scene, handles the other stuff automatically
+/// Parses a decimal float at p and advances p past it. Mantissas of up to 15 digits with small exponents are
+/// exact in double, which covers every asset dump we have, anything longer goes through strtod.
 /// </summary>
-/// <param name="scene"></param>
-/// <param name="outputName"></param>
-/// <returns></returns>
-int NtRenderScene(NtScene* scene, const std::string outputName, NT_SHADING_MODE shadingMode) {
-	int status = 0;
-	NtDisplay* displayPtr;
-	status |= NtNewDisplay(&displayPtr, scene->camera.xRes, scene->camera.yRes);
-	NtRender* renderPtr;
-	status |= NtNewRender(&renderPtr, displayPtr);
-	status |= NtSetRenderAttributes(renderPtr, scene);
-	status |= NtSetShadingMode(renderPtr, shadingMode);
-	//Put camera and matrix
-	status |= NtPutCamera(renderPtr, scene->camera);
-	if (status) return NT_FAILURE;
+/// <param name="p"></param>
+/// <param name="end"></param>
+/// <param name="value"></param>
+/// <returns>False if no number starts at p</returns>
+static bool NtParseFloat(const char*& p, const char* end, float& value) {
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	const char* start = p;
+	const char* c = p;
+	bool negative = false;
+	if (c < end && (*c == '-' || *c == '+')) {
+		negative = *c == '-';
+		c++;
+	}
 
-	std::vector<NtRender*> sampleRenders;
-	sampleRenders.resize(displayPtr->sampleCount);
-	//Init sample renders
-	for (int i = 0; i < displayPtr->sampleCount; i++) {
-		NtRender* render;
-		status |= NtNewRender(&render, displayPtr, i);
-		status |= NtSetRenderAttributes(render, scene);
-		status |= NtSetShadingMode(render, shadingMode);
-		status |= NtPutCamera(render, scene->camera);
-		sampleRenders[i] = render;
+	unsigned long long mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool any = false;
+	for (; c < end && *c >= '0' && *c <= '9'; c++, any = true) {
+		if (mantissa != 0 || *c != '0') digits++;
+		if (digits <= 19) mantissa = mantissa * 10 + (*c - '0');
+		else exponent++;
+	}
+	if (c < end && *c == '.') {
+		for (c++; c < end && *c >= '0' && *c <= '9'; c++, any = true) {
+			if (mantissa != 0 || *c != '0') digits++;
+			if (digits <= 19) {
+				mantissa = mantissa * 10 + (*c - '0');
+				exponent--;
+			}
+		}
+	}
+	if (!any) {
+		return false;
+	}
+	if (c < end && (*c == 'e' || *c == 'E')) {
+		const char* e = c + 1;
+		bool negativeExponent = false;
+		if (e < end && (*e == '-' || *e == '+')) {
+			negativeExponent = *e == '-';
+			e++;
+		}
+		if (e < end && *e >= '0' && *e <= '9') {
+			int explicitExponent = 0;
+			for (; e < end && *e >= '0' && *e <= '9'; e++) {
+				if (explicitExponent < 10000) explicitExponent = explicitExponent * 10 + (*e - '0');
+			}
+			exponent += negativeExponent ? -explicitExponent : explicitExponent;
+			c = e;
+		}
 	}
+	p = c;
+
+	if (digits <= 15 && exponent >= -22 && exponent <= 22) {
+		double result = (double)mantissa;
+		result = exponent < 0 ? result / powers[-exponent] : result * powers[exponent];
+		value = (float)(negative ? -result : result);
+		return true;
+	}
+	char text[128];
+	size_t length = std::min((size_t)(c - start), sizeof(text) - 1);
+	std::memcpy(text, start, length);
+	text[length] = '\0';
+	value = (float)std::strtod(text, nullptr);
+	return true;
+}
+
+//Scans the {"data":[{"v0":{"v":[..],"n":[..],"t":[..]},"v1":..,"v2":..}, ...]} mesh layout straight into triangles
+//without building a DOM or allocating per token. Keys may come in any order, unknown keys are skipped and missing
+//values stay zero. Structure is checked for balance only, this is a loader for our own assets, not a validator.
+class NtMeshJsonScanner {
+public:
+	NtMeshJsonScanner(const char* begin, const char* end, NtMesh* mesh) : p(begin), end(end), mesh(mesh) {}
+	std::string error;
+
+	bool Run() {
+		mesh->triangles.reserve(CountTriangles());
+		while (SkipWhitespace()) {
+			char c = *p;
+			switch (c) {
+			case '{':
+				p++;
+				depth++;
+				if (inData && depth == 3) triangle = NtTriangle();
+				break;
+			case '}':
+				p++;
+				if (inData && depth == 3) mesh->triangles.push_back(triangle);
+				if (--depth < 0) return Fail("unbalanced }");
+				break;
+			case '[':
+				p++;
+				depth++;
+				if (depth == 2 && dataKey) inData = sawData = true;
+				component = 0;
+				break;
+			case ']':
+				p++;
+				if (depth == 2) inData = false;
+				if (--depth < 0) return Fail("unbalanced ]");
+				break;
+			case ',':
+			case ':':
+				p++;
+				break;
+			case '"': {
+				const char* name = ++p;
+				while (p < end && *p != '"') {
+					p += (*p == '\\') ? 2 : 1;
+				}
+				if (p >= end) return Fail("unterminated string");
+				size_t length = p - name;
+				p++;
+				if (SkipWhitespace() && *p == ':') Key(name, length);
+				break;
+			}
+			case 't': case 'f': case 'n':
+				while (p < end && *p >= 'a' && *p <= 'z') p++;
+				break;
+			default: {
+				float value;
+				if (!NtParseFloat(p, end, value)) return Fail(std::string("unexpected character ") + c);
+				if (inData && depth == 5 && attribute != nullptr && component < attributeSize) {
+					attribute[component++] = value;
+				}
+				break;
+			}
+			}
+		}
+		if (depth != 0) return Fail("unexpected end of file");
+		return sawData ? true : Fail("no top level data array");
+	}
+
+private:
+	//Every triangle has one "v0" key, counted up front so the triangles are stored without regrowing
+	size_t CountTriangles() const {
+		size_t count = 0;
+		for (const char* q = p; q + 4 <= end; q++) {
+			q = (const char*)std::memchr(q, '"', end - q);
+			if (q == nullptr || q + 4 > end) break;
+			if (q[1] == 'v' && q[2] == '0' && q[3] == '"') count++;
+		}
+		return count;
+	}
+
+	bool SkipWhitespace() {
+		while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) p++;
+		return p < end;
+	}
+
+	bool Fail(const std::string& message) {
+		error = message;
+		return false;
+	}
+
+	static bool Equals(const char* name, size_t length, const char* literal) {
+		return length == std::strlen(literal) && std::memcmp(name, literal, length) == 0;
+	}
+
+	void Key(const char* name, size_t length) {
+		if (depth == 1) {
+			dataKey = Equals(name, length, "data");
+		}
+		else if (inData && depth == 3) {
+			vertex = Equals(name, length, "v0") ? &triangle.v0 : Equals(name, length, "v1") ? &triangle.v1 :
+				Equals(name, length, "v2") ? &triangle.v2 : nullptr;
+		}
+		else if (inData && depth == 4) {
+			attribute = nullptr;
+			if (vertex == nullptr) return;
+			if (Equals(name, length, "v")) { attribute = vertex->vertexPos.v; attributeSize = 3; }
+			else if (Equals(name, length, "n")) { attribute = vertex->vertexNormal.v; attributeSize = 3; }
+			else if (Equals(name, length, "t")) { attribute = vertex->texture.v; attributeSize = 2; }
+		}
+	}
+
+	const char* p;
+	const char* end;
+	NtMesh* mesh;
+	NtTriangle triangle;
+	NtVertex* vertex = nullptr;
+	float* attribute = nullptr;
+	int attributeSize = 0;
+	int component = 0;
+	int depth = 0;
+	bool dataKey = false;
+	bool inData = false;
+	bool sawData = false;
+};
+
+/// <summary>
+/// Reads a legacy .asc triangle list: a "triangle" tag followed by three vertices of
+/// "x y z nx ny nz u v". Any whitespace, including the classic Mac \r line endings of our dumps, separates values.
+/// </summary>
+/// <param name="begin"></param>
+/// <param name="end"></param>
+/// <param name="mesh"></param>
+/// <param name="error"></param>
+/// <returns></returns>
+static bool NtScanAscMesh(const char* begin, const char* end, NtMesh* mesh, std::string& error) {
+	const char* p = begin;
+	auto skipWhitespace = [&]() {
+		while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) p++;
+		return p < end;
+	};
+
+	mesh->triangles.reserve((end - begin) / 220); //Typical record length of the dumps
+	while (skipWhitespace()) {
+		//Record tag, any word
+		if (!((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z'))) {
+			error = "expected triangle tag at byte " + std::to_string(p - begin);
+			return false;
+		}
+		while (p < end && *p != ' ' && *p != '\n' && *p != '\r' && *p != '\t') p++;
+
+		NtTriangle triangle;
+		NtVertex* vertices[3] = { &triangle.v0, &triangle.v1, &triangle.v2 };
+		for (NtVertex* vertex : vertices) {
+			float* targets[8] = { &vertex->vertexPos.x, &vertex->vertexPos.y, &vertex->vertexPos.z,
+				&vertex->vertexNormal.x, &vertex->vertexNormal.y, &vertex->vertexNormal.z, &vertex->texture.x, &vertex->texture.y };
+			for (float* target : targets) {
+				if (!skipWhitespace() || !NtParseFloat(p, end, *target)) {
+					error = "truncated triangle " + std::to_string(mesh->triangles.size());
+					return false;
+				}
+			}
+		}
+		mesh->triangles.push_back(triangle);
+	}
+	return true;
+}
+
+//Wavefront OBJ. The file is split into one chunk per core on line boundaries and each chunk is parsed on its own.
+//Indices are 1 based and global, negative indices count back from the last vertex seen, so chunks keep those
+//relative to the chunk's first attribute until every chunk's attribute counts are known and offsets can be applied.
+#define NT_OBJ_MISSING INT_MIN
+
+typedef struct NtObjCorner {
+	int position = NT_OBJ_MISSING;
+	int uv = NT_OBJ_MISSING;
+	int normal = NT_OBJ_MISSING;
+	unsigned char relative = 0; //Bit 0 position, 1 uv, 2 normal: index is relative to the chunk start and may be negative
+} NtObjCorner;
+
+typedef struct NtObjChunk {
+	std::vector<Vector3> positions;
+	std::vector<Vector2> uvs;
+	std::vector<Vector3> normals;
+	std::vector<NtObjCorner> corners;
+	std::vector<int> polygonSizes;
+	size_t triangleCount = 0;
+	std::string error;
+} NtObjChunk;
+
+/// <summary>
+/// Parses one OBJ index. Positive indices become 0 based global indices, negative ones are resolved against the
+/// chunk's count so far and flagged relative for NtReadObjMesh to offset.
+/// </summary>
+static bool NtParseObjIndex(const char*& p, const char* end, int localCount, int& index, unsigned char& relative, unsigned char bit) {
+	bool negative = p < end && *p == '-';
+	if (negative) p++;
+	if (p >= end || *p < '0' || *p > '9') return false;
+	long long value = 0;
+	for (; p < end && *p >= '0' && *p <= '9'; p++) {
+		value = std::min(value * 10 + (*p - '0'), (long long)INT_MAX);
+	}
+	if (negative) {
+		if (value == 0) return false;
+		index = (int)(localCount - value);
+		relative |= bit;
+	}
+	else {
+		if (value == 0) return false;
+		index = (int)value - 1;
+	}
+	return true;
+}
+
+static void NtParseObjChunk(const char* p, const char* end, NtObjChunk& chunk) {
+	auto skipBlank = [](const char*& c, const char* lineEnd) {
+		while (c < lineEnd && (*c == ' ' || *c == '\t')) c++;
+	};
+	while (p < end) {
+		const char* lineEnd = (const char*)std::memchr(p, '\n', end - p);
+		if (lineEnd == nullptr) lineEnd = end;
+		const char* next = lineEnd + (lineEnd < end ? 1 : 0);
+		if (lineEnd > p && lineEnd[-1] == '\r') lineEnd--;
+
+		const char* c = p;
+		skipBlank(c, lineEnd);
+		if (c + 1 < lineEnd && c[0] == 'v' && (c[1] == ' ' || c[1] == '\t')) {
+			Vector3 position;
+			c++;
+			for (int i = 0; i < 3; i++) {
+				skipBlank(c, lineEnd);
+				if (!NtParseFloat(c, lineEnd, position.v[i])) { chunk.error = "bad vertex"; return; }
+			}
+			chunk.positions.push_back(position);
+		}
+		else if (c + 2 < lineEnd && c[0] == 'v' && c[1] == 'n' && (c[2] == ' ' || c[2] == '\t')) {
+			Vector3 normal;
+			c += 2;
+			for (int i = 0; i < 3; i++) {
+				skipBlank(c, lineEnd);
+				if (!NtParseFloat(c, lineEnd, normal.v[i])) { chunk.error = "bad normal"; return; }
+			}
+			chunk.normals.push_back(normal);
+		}
+		else if (c + 2 < lineEnd && c[0] == 'v' && c[1] == 't' && (c[2] == ' ' || c[2] == '\t')) {
+			Vector2 uv;
+			c += 2;
+			for (int i = 0; i < 2; i++) {
+				skipBlank(c, lineEnd);
+				//A 1D texture coordinate leaves v at zero
+				if (!NtParseFloat(c, lineEnd, uv.v[i]) && i == 0) { chunk.error = "bad texture coordinate"; return; }
+			}
+			chunk.uvs.push_back(uv);
+		}
+		else if (c + 1 < lineEnd && c[0] == 'f' && (c[1] == ' ' || c[1] == '\t')) {
+			c++;
+			int cornerCount = 0;
+			while (true) {
+				skipBlank(c, lineEnd);
+				if (c >= lineEnd || *c == '#') break;
+				NtObjCorner corner;
+				if (!NtParseObjIndex(c, lineEnd, (int)chunk.positions.size(), corner.position, corner.relative, 1)) { chunk.error = "bad face"; return; }
+				if (c < lineEnd && *c == '/') {
+					c++;
+					if (c < lineEnd && *c != '/' && !NtParseObjIndex(c, lineEnd, (int)chunk.uvs.size(), corner.uv, corner.relative, 2)) { chunk.error = "bad face"; return; }
+					if (c < lineEnd && *c == '/') {
+						c++;
+						if (!NtParseObjIndex(c, lineEnd, (int)chunk.normals.size(), corner.normal, corner.relative, 4)) { chunk.error = "bad face"; return; }
+					}
+				}
+				chunk.corners.push_back(corner);
+				cornerCount++;
+			}
+			if (cornerCount >= 3) {
+				chunk.polygonSizes.push_back(cornerCount);
+				chunk.triangleCount += cornerCount - 2;
+			}
+			else {
+				chunk.corners.resize(chunk.corners.size() - cornerCount);
+			}
+		}
+		//Groups, objects, materials, smoothing groups and comments don't affect geometry
+		p = next;
+	}
+}
+
+/// <summary>
+/// Builds a triangle from three resolved corners, corners without a normal get the face normal
+/// </summary>
+static void NtBuildTriangle(NtTriangle& triangle, const Vector3 positions[3], const Vector3* normals[3], const Vector2* uvs[3]) {
+	NtVertex* vertices[3] = { &triangle.v0, &triangle.v1, &triangle.v2 };
+	Vector3 faceNormal;
+	if (normals[0] == nullptr || normals[1] == nullptr || normals[2] == nullptr) {
+		faceNormal = Vector3::cross(positions[1] - positions[0], positions[2] - positions[0]);
+		if (faceNormal.dot(faceNormal) > 0) faceNormal.normalize();
+	}
+	for (int i = 0; i < 3; i++) {
+		vertices[i]->vertexPos = positions[i];
+		vertices[i]->vertexNormal = normals[i] != nullptr ? *normals[i] : faceNormal;
+		vertices[i]->texture = uvs[i] != nullptr ? *uvs[i] : Vector2();
+	}
+}
+
+/// <summary>
+/// Reads a Wavefront OBJ (v, vt, vn, f) into triangles, polygons are fan triangulated, so they must be convex
+/// </summary>
+static bool NtReadObjMesh(const char* begin, const char* end, NtMesh* mesh, std::string& error) {
+	//Chunks of at least 1 MB, one per core
+	size_t size = end - begin;
+	int chunkCount = (int)std::max<size_t>(1, std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), size >> 20));
+	std::vector<const char*> bounds(chunkCount + 1, end);
+	bounds[0] = begin;
+	for (int i = 1; i < chunkCount; i++) {
+		const char* split = std::max(begin + size * i / chunkCount, bounds[i - 1]);
+		const char* newline = (const char*)std::memchr(split, '\n', end - split);
+		bounds[i] = newline == nullptr ? end : newline + 1;
+	}
+
+	std::vector<NtObjChunk> chunks(chunkCount);
+	NtParallelFor(0, chunkCount, [&](int chunkBegin, int chunkEnd) {
+		for (int i = chunkBegin; i < chunkEnd; i++) {
+			NtParseObjChunk(bounds[i], bounds[i + 1], chunks[i]);
+		}
+	});
+
+	//Concatenate attributes and remember where each chunk's start
+	std::vector<int> positionOffsets(chunkCount), uvOffsets(chunkCount), normalOffsets(chunkCount);
+	std::vector<size_t> triangleOffsets(chunkCount);
+	std::vector<Vector3> positions, normals;
+	std::vector<Vector2> uvs;
+	size_t triangleCount = 0;
+	for (int i = 0; i < chunkCount; i++) {
+		if (!chunks[i].error.empty()) {
+			error = chunks[i].error;
+			return false;
+		}
+		positionOffsets[i] = (int)positions.size();
+		uvOffsets[i] = (int)uvs.size();
+		normalOffsets[i] = (int)normals.size();
+		triangleOffsets[i] = triangleCount;
+		positions.insert(positions.end(), chunks[i].positions.begin(), chunks[i].positions.end());
+		uvs.insert(uvs.end(), chunks[i].uvs.begin(), chunks[i].uvs.end());
+		normals.insert(normals.end(), chunks[i].normals.begin(), chunks[i].normals.end());
+		triangleCount += chunks[i].triangleCount;
+		std::vector<Vector3>().swap(chunks[i].positions);
+		std::vector<Vector2>().swap(chunks[i].uvs);
+		std::vector<Vector3>().swap(chunks[i].normals);
+	}
+
+	mesh->triangles.resize(triangleCount);
+	std::atomic<bool> outOfRange(false);
+	NtParallelFor(0, chunkCount, [&](int chunkBegin, int chunkEnd) {
+		for (int i = chunkBegin; i < chunkEnd; i++) {
+			auto resolve = [](int index, bool relative, int offset, size_t count) {
+				if (index == NT_OBJ_MISSING) return -1;
+				long long resolved = relative ? (long long)offset + index : index;
+				return resolved >= 0 && resolved < (long long)count ? (int)resolved : -2;
+			};
+			const NtObjChunk& chunk = chunks[i];
+			size_t triangle = triangleOffsets[i];
+			size_t corner = 0;
+			for (int polygonSize : chunk.polygonSizes) {
+				const NtObjCorner* polygon = &chunk.corners[corner];
+				corner += polygonSize;
+				for (int k = 2; k < polygonSize; k++) {
+					int fan[3] = { 0, k - 1, k };
+					Vector3 trianglePositions[3];
+					const Vector3* triangleNormals[3];
+					const Vector2* triangleUVs[3];
+					for (int j = 0; j < 3; j++) {
+						const NtObjCorner& c = polygon[fan[j]];
+						int position = resolve(c.position, c.relative & 1, positionOffsets[i], positions.size());
+						int uv = resolve(c.uv, c.relative & 2, uvOffsets[i], uvs.size());
+						int normal = resolve(c.normal, c.relative & 4, normalOffsets[i], normals.size());
+						if (position < 0 || uv == -2 || normal == -2) {
+							outOfRange = true;
+							return;
+						}
+						trianglePositions[j] = positions[position];
+						triangleUVs[j] = uv >= 0 ? &uvs[uv] : nullptr;
+						triangleNormals[j] = normal >= 0 ? &normals[normal] : nullptr;
+					}
+					NtBuildTriangle(mesh->triangles[triangle++], trianglePositions, triangleNormals, triangleUVs);
+				}
+			}
+		}
+	});
+	if (outOfRange) {
+		error = "face index out of range";
+		return false;
+	}
+	return true;
+}
+
+//Binary PLY, little or big endian. Vertex records have a fixed stride and are decoded in parallel, face records
+//hold variable length index lists and are walked once to find them before triangles are built in parallel.
+enum NT_PLY_TYPE {
+	NT_PLY_INT8, NT_PLY_UINT8, NT_PLY_INT16, NT_PLY_UINT16, NT_PLY_INT32, NT_PLY_UINT32, NT_PLY_FLOAT32, NT_PLY_FLOAT64, NT_PLY_INVALID
+};
+
+typedef struct NtPlyProperty {
+	std::string name;
+	NT_PLY_TYPE type = NT_PLY_INVALID;
+	NT_PLY_TYPE countType = NT_PLY_INVALID; //Valid for list properties only
+} NtPlyProperty;
+
+typedef struct NtPlyElement {
+	std::string name;
+	size_t count = 0;
+	std::vector<NtPlyProperty> properties;
+} NtPlyElement;
+
+static const int ntPlyTypeSizes[] = { 1, 1, 2, 2, 4, 4, 4, 8, 0 };
+
+static NT_PLY_TYPE NtPlyTypeFromName(const std::string& name) {
+	if (name == "char" || name == "int8") return NT_PLY_INT8;
+	if (name == "uchar" || name == "uint8") return NT_PLY_UINT8;
+	if (name == "short" || name == "int16") return NT_PLY_INT16;
+	if (name == "ushort" || name == "uint16") return NT_PLY_UINT16;
+	if (name == "int" || name == "int32") return NT_PLY_INT32;
+	if (name == "uint" || name == "uint32") return NT_PLY_UINT32;
+	if (name == "float" || name == "float32") return NT_PLY_FLOAT32;
+	if (name == "double" || name == "float64") return NT_PLY_FLOAT64;
+	return NT_PLY_INVALID;
+}
+
+static double NtReadPlyValue(const char* data, NT_PLY_TYPE type, bool bigEndian) {
+	unsigned char bytes[8];
+	int size = ntPlyTypeSizes[type];
+	for (int i = 0; i < size; i++) {
+		bytes[i] = (unsigned char)data[bigEndian ? size - 1 - i : i];
+	}
+	switch (type) {
+	case NT_PLY_INT8: { signed char v; std::memcpy(&v, bytes, 1); return v; }
+	case NT_PLY_UINT8: return bytes[0];
+	case NT_PLY_INT16: { short v; std::memcpy(&v, bytes, 2); return v; }
+	case NT_PLY_UINT16: { unsigned short v; std::memcpy(&v, bytes, 2); return v; }
+	case NT_PLY_INT32: { int v; std::memcpy(&v, bytes, 4); return v; }
+	case NT_PLY_UINT32: { unsigned int v; std::memcpy(&v, bytes, 4); return v; }
+	case NT_PLY_FLOAT32: { float v; std::memcpy(&v, bytes, 4); return v; }
+	case NT_PLY_FLOAT64: { double v; std::memcpy(&v, bytes, 8); return v; }
+	default: return 0;
+	}
+}
+
+/// <summary>
+/// Returns the byte size of one record of element starting at data, or 0 if it runs past end
+/// </summary>
+static size_t NtPlyRecordSize(const NtPlyElement& element, const char* data, const char* end, bool bigEndian) {
+	size_t size = 0;
+	for (const NtPlyProperty& property : element.properties) {
+		if (property.countType == NT_PLY_INVALID) {
+			size += ntPlyTypeSizes[property.type];
+			continue;
+		}
+		if (data + size + ntPlyTypeSizes[property.countType] > end) return 0;
+		size_t count = (size_t)NtReadPlyValue(data + size, property.countType, bigEndian);
+		size += ntPlyTypeSizes[property.countType] + count * ntPlyTypeSizes[property.type];
+	}
+	return data + size <= end ? size : 0;
+}
+
+/// <summary>
+/// Reads a binary PLY with a vertex element (x y z, optional nx ny nz and u v / s t) and a face element with a
+/// vertex_indices list. Other elements and properties are skipped, polygons are fan triangulated.
+/// </summary>
+static bool NtReadPlyMesh(const char* begin, const char* end, NtMesh* mesh, std::string& error) {
+	//Header
+	if (end - begin < 4 || std::memcmp(begin, "ply", 3) != 0) {
+		error = "not a PLY file";
+		return false;
+	}
+	const char* p = begin;
+	bool bigEndian = false;
+	bool formatFound = false;
+	std::vector<NtPlyElement> elements;
+	while (true) {
+		const char* lineEnd = (const char*)std::memchr(p, '\n', end - p);
+		if (lineEnd == nullptr) {
+			error = "missing end_header";
+			return false;
+		}
+		std::string line(p, lineEnd > p && lineEnd[-1] == '\r' ? lineEnd - 1 : lineEnd);
+		p = lineEnd + 1;
+
+		std::vector<std::string> tokens;
+		size_t position = 0;
+		while (position < line.size()) {
+			size_t tokenEnd = line.find_first_of(" \t", position);
+			if (tokenEnd == std::string::npos) tokenEnd = line.size();
+			if (tokenEnd > position) tokens.push_back(line.substr(position, tokenEnd - position));
+			position = tokenEnd + 1;
+		}
+		if (tokens.empty()) continue;
+
+		if (tokens[0] == "ply") continue;
+		if (tokens[0] == "end_header") break;
+		if (tokens[0] == "format" && tokens.size() >= 2) {
+			if (tokens[1] == "binary_little_endian") bigEndian = false;
+			else if (tokens[1] == "binary_big_endian") bigEndian = true;
+			else {
+				error = "only binary PLY is supported, got " + tokens[1];
+				return false;
+			}
+			formatFound = true;
+		}
+		else if (tokens[0] == "element" && tokens.size() >= 3) {
+			NtPlyElement element;
+			element.name = tokens[1];
+			element.count = std::strtoull(tokens[2].c_str(), nullptr, 10);
+			elements.push_back(element);
+		}
+		else if (tokens[0] == "property" && !elements.empty()) {
+			NtPlyProperty property;
+			if (tokens.size() >= 5 && tokens[1] == "list") {
+				property.countType = NtPlyTypeFromName(tokens[2]);
+				property.type = NtPlyTypeFromName(tokens[3]);
+				property.name = tokens[4];
+				if (property.countType == NT_PLY_INVALID) {
+					error = "unknown PLY type " + tokens[2];
+					return false;
+				}
+			}
+			else if (tokens.size() >= 3) {
+				property.type = NtPlyTypeFromName(tokens[1]);
+				property.name = tokens[2];
+			}
+			if (property.type == NT_PLY_INVALID) {
+				error = "unknown PLY property " + line;
+				return false;
+			}
+			elements.back().properties.push_back(property);
+		}
+		//comment and obj_info lines are ignored
+	}
+	if (!formatFound) {
+		error = "missing format line";
+		return false;
+	}
+
+	std::vector<Vector3> positions, normals;
+	std::vector<Vector2> uvs;
+	std::vector<unsigned int> indices;
+	std::vector<size_t> polygonStarts; //Offset into indices, one extra entry closes the last polygon
+	for (const NtPlyElement& element : elements) {
+		if (element.name == "vertex") {
+			//Attribute slots: x y z nx ny nz u v, -1 when absent
+			int slots[8] = { -1, -1, -1, -1, -1, -1, -1, -1 };
+			std::vector<size_t> offsets;
+			size_t stride = 0;
+			for (size_t i = 0; i < element.properties.size(); i++) {
+				const NtPlyProperty& property = element.properties[i];
+				if (property.countType != NT_PLY_INVALID) {
+					error = "list properties on vertices are not supported";
+					return false;
+				}
+				const std::string& n = property.name;
+				int slot = n == "x" ? 0 : n == "y" ? 1 : n == "z" ? 2 : n == "nx" ? 3 : n == "ny" ? 4 : n == "nz" ? 5 :
+					(n == "u" || n == "s" || n == "texture_u" || n == "texture_s") ? 6 :
+					(n == "v" || n == "t" || n == "texture_v" || n == "texture_t") ? 7 : -1;
+				if (slot >= 0) slots[slot] = (int)i;
+				offsets.push_back(stride);
+				stride += ntPlyTypeSizes[property.type];
+			}
+			if (slots[0] < 0 || slots[1] < 0 || slots[2] < 0) {
+				error = "vertices need x, y and z";
+				return false;
+			}
+			if ((size_t)(end - p) < stride * element.count) {
+				error = "truncated vertex data";
+				return false;
+			}
+			bool hasNormals = slots[3] >= 0 && slots[4] >= 0 && slots[5] >= 0;
+			bool hasUVs = slots[6] >= 0 && slots[7] >= 0;
+			positions.resize(element.count);
+			if (hasNormals) normals.resize(element.count);
+			if (hasUVs) uvs.resize(element.count);
+			const char* vertexData = p;
+			NtParallelFor(0, (int)element.count, [&](int vertexBegin, int vertexEnd) {
+				for (int i = vertexBegin; i < vertexEnd; i++) {
+					const char* record = vertexData + stride * i;
+					auto read = [&](int slot) {
+						return (float)NtReadPlyValue(record + offsets[slots[slot]], element.properties[slots[slot]].type, bigEndian);
+					};
+					positions[i] = Vector3(read(0), read(1), read(2));
+					if (hasNormals) normals[i] = Vector3(read(3), read(4), read(5));
+					if (hasUVs) uvs[i].x = read(6), uvs[i].y = read(7);
+				}
+			}, 4096);
+			p += stride * element.count;
+		}
+		else if (element.name == "face") {
+			int listIndex = -1;
+			for (size_t i = 0; i < element.properties.size(); i++) {
+				const NtPlyProperty& property = element.properties[i];
+				if (property.countType != NT_PLY_INVALID && (property.name == "vertex_indices" || property.name == "vertex_index")) {
+					listIndex = (int)i;
+				}
+			}
+			if (listIndex < 0) {
+				error = "faces need a vertex_indices list";
+				return false;
+			}
+			indices.reserve(element.count * 3);
+			polygonStarts.reserve(element.count + 1);
+			for (size_t f = 0; f < element.count; f++) {
+				const char* record = p;
+				for (size_t i = 0; i < element.properties.size(); i++) {
+					const NtPlyProperty& property = element.properties[i];
+					if (property.countType == NT_PLY_INVALID) {
+						record += ntPlyTypeSizes[property.type];
+						continue;
+					}
+					if (record + ntPlyTypeSizes[property.countType] > end) {
+						error = "truncated face data";
+						return false;
+					}
+					size_t count = (size_t)NtReadPlyValue(record, property.countType, bigEndian);
+					record += ntPlyTypeSizes[property.countType];
+					int itemSize = ntPlyTypeSizes[property.type];
+					if (record + count * itemSize > end) {
+						error = "truncated face data";
+						return false;
+					}
+					if ((int)i == listIndex && count >= 3) {
+						polygonStarts.push_back(indices.size());
+						for (size_t k = 0; k < count; k++) {
+							indices.push_back((unsigned int)NtReadPlyValue(record + k * itemSize, property.type, bigEndian));
+						}
+					}
+					record += count * itemSize;
+				}
+				p = record;
+			}
+			polygonStarts.push_back(indices.size());
+		}
+		else {
+			//Unknown element, skip its records
+			for (size_t r = 0; r < element.count; r++) {
+				size_t size = NtPlyRecordSize(element, p, end, bigEndian);
+				if (size == 0 && !element.properties.empty()) {
+					error = "truncated " + element.name + " data";
+					return false;
+				}
+				p += size;
+			}
+		}
+	}
+	if (polygonStarts.empty()) {
+		return true;
+	}
+
+	//Fan triangulation, triangle offsets per polygon let the build run in parallel
+	int polygonCount = (int)polygonStarts.size() - 1;
+	std::vector<size_t> triangleOffsets(polygonCount + 1, 0);
+	for (int i = 0; i < polygonCount; i++) {
+		triangleOffsets[i + 1] = triangleOffsets[i] + (polygonStarts[i + 1] - polygonStarts[i] - 2);
+	}
+	mesh->triangles.resize(triangleOffsets[polygonCount]);
+	std::atomic<bool> outOfRange(false);
+	NtParallelFor(0, polygonCount, [&](int polygonBegin, int polygonEnd) {
+		for (int i = polygonBegin; i < polygonEnd; i++) {
+			const unsigned int* polygon = &indices[polygonStarts[i]];
+			int polygonSize = (int)(polygonStarts[i + 1] - polygonStarts[i]);
+			for (int k = 2; k < polygonSize; k++) {
+				unsigned int fan[3] = { polygon[0], polygon[k - 1], polygon[k] };
+				Vector3 trianglePositions[3];
+				const Vector3* triangleNormals[3];
+				const Vector2* triangleUVs[3];
+				for (int j = 0; j < 3; j++) {
+					if (fan[j] >= positions.size()) {
+						outOfRange = true;
+						return;
+					}
+					trianglePositions[j] = positions[fan[j]];
+					triangleNormals[j] = normals.empty() ? nullptr : &normals[fan[j]];
+					triangleUVs[j] = uvs.empty() ? nullptr : &uvs[fan[j]];
+				}
+				NtBuildTriangle(mesh->triangles[triangleOffsets[i] + k - 2], trianglePositions, triangleNormals, triangleUVs);
+			}
+		}
+	}, 1024);
+	if (outOfRange) {
+		error = "face index out of range";
+		return false;
+	}
+	return true;
+}
+
+
+/// <summary>
+/// Returns the file a scene geometry id refers to, ids without a known mesh extension name a JSON mesh
+/// </summary>
+/// <param name="geometryId"></param>
+/// <returns></returns>
+std::string NtResolveMeshPath(const std::string& geometryId) {
+	static const char* extensions[] = { ".json", ".asc", ".obj", ".ply" };
+	for (const char* extension : extensions) {
+		size_t length = std::strlen(extension);
+		if (geometryId.size() > length && geometryId.compare(geometryId.size() - length, length, extension) == 0) {
+			return geometryId;
+		}
+	}
+	return geometryId + ".json";
+}
+
+/// <summary>
+/// Reads a mesh file into a new mesh owned by the caller, independent of any scene. The format follows the
+/// extension: .asc triangle lists, Wavefront .obj, binary .ply, or JSON otherwise. The file is memory mapped and scanned in place.
+/// </summary>
+/// <param name="path"></param>
+/// <param name="mesh"></param>
+/// <returns></returns>
+int NtReadMeshFile(const std::string& path, NtMesh** mesh) {
+	NtMappedFile file;
+	if (!file.Open(path)) {
+		NtLog(std::cout, "File with name " + path + " could not be found\n");
+		return NT_FAILURE;
+	}
+	return NtReadMeshFile(path, file.Begin(), file.End(), mesh);
+}
+
+/// <summary>
+/// Parses mesh file bytes already in memory into a new mesh owned by the caller, path only picks the format
+/// </summary>
+/// <param name="path"></param>
+/// <param name="begin"></param>
+/// <param name="end"></param>
+/// <param name="mesh"></param>
+/// <returns></returns>
+int NtReadMeshFile(const std::string& path, const char* begin, const char* end, NtMesh** mesh) {
+	NT_TRACE_SCOPE("NtReadMeshFile", path.c_str());
+	auto hasExtension = [&path](const char* extension) {
+		size_t length = std::strlen(extension);
+		return path.size() > length && path.compare(path.size() - length, length, extension) == 0;
+	};
+
+	*mesh = new NtMesh();
+	std::string error;
+	bool parsed;
+	if (hasExtension(".asc")) {
+		parsed = NtScanAscMesh(begin, end, *mesh, error);
+	}
+	else if (hasExtension(".obj")) {
+		parsed = NtReadObjMesh(begin, end, *mesh, error);
+	}
+	else if (hasExtension(".ply")) {
+		parsed = NtReadPlyMesh(begin, end, *mesh, error);
+	}
+	else {
+		NtMeshJsonScanner scanner(begin, end, *mesh);
+		parsed = scanner.Run();
+		error = scanner.error;
+	}
+	if (!parsed) {
+		NtLog(std::cerr, "Error parsing mesh " + path + " " + error + "\n");
+		delete *mesh;
+		*mesh = nullptr;
+		return NT_FAILURE;
+	}
+	return NT_SUCCESS;
+}
+
+//Asset cache. Entries are keyed by a hash of the file bytes so identical files under different paths share one copy,
+//and a per path record of size and modification time lets repeated acquires skip rereading the file.
+#define NT_ASSET_MESH 0
+#define NT_ASSET_TEXTURE 1
+
+typedef struct NtAssetEntry {
+	void* asset = nullptr;
+	int kind = NT_ASSET_MESH;
+	size_t bytes = 0;
+	int refCount = 0;
+	std::list<unsigned long long>::iterator idlePosition; //Valid only while refCount is 0
+} NtAssetEntry;
+
+typedef struct NtAssetPathRecord {
+	std::filesystem::file_time_type modifiedTime;
+	uintmax_t fileSize = 0;
+	unsigned long long key = 0;
+} NtAssetPathRecord;
+
+static struct {
+	std::mutex mutex;
+	std::unordered_map<unsigned long long, NtAssetEntry> entries;
+	std::unordered_map<std::string, NtAssetPathRecord> paths; //Variant prefixed canonical path
+	std::unordered_map<const void*, unsigned long long> owners;
+	std::list<unsigned long long> idle; //Unreferenced entries, most recently released first
+	size_t residentBytes = 0;
+	size_t budgetBytes = NT_ASSET_CACHE_DEFAULT_BUDGET;
+	std::atomic<int> textureLayout{ NT_TEXTURE_LINEAR }; //Layout decoded textures are stored in
+	std::atomic<int> textureTileSize{ NT_TEXTURE_TILE_SIZE };
+	int hits = 0;
+	int misses = 0;
+	int evictions = 0;
+} ntAssetCache;
+
+/// <summary>
+/// 64 bit FNV-1a over the asset variant and file bytes, a collision is treated as identical content
+/// </summary>
+/// <param name="variant">Asset kind plus any load options that change the decoded asset</param>
+/// <param name="begin"></param>
+/// <param name="end"></param>
+/// <returns></returns>
+static unsigned long long NtHashAssetBytes(int variant, const char* begin, const char* end) {
+	unsigned long long key = 14695981039346656037ull;
+	for (int i = 0; i < 4; i++) {
+		key = (key ^ (unsigned char)(variant >> (i * 8))) * 1099511628211ull;
+	}
+	for (const char* byte = begin; byte < end; byte++) {
+		key = (key ^ (unsigned char)*byte) * 1099511628211ull;
+	}
+	return key;
+}
+
+static void NtDeleteAsset(int kind, void* asset) {
+	if (kind == NT_ASSET_MESH) delete (NtMesh*)asset;
+	else delete (NtTexture*)asset;
+}
+
+/// <summary>
+/// Takes a reference on a resident entry, caller holds the cache lock
+/// </summary>
+static void* NtReferenceAsset(NtAssetEntry& entry) {
+	if (entry.refCount++ == 0) {
+		ntAssetCache.idle.erase(entry.idlePosition);
+	}
+	return entry.asset;
+}
+
+/// <summary>
+/// Evicts least recently used unreferenced entries until resident bytes fit the budget, caller holds the cache lock
+/// </summary>
+static void NtEvictAssets(size_t budgetBytes) {
+	while (ntAssetCache.residentBytes > budgetBytes && !ntAssetCache.idle.empty()) {
+		unsigned long long key = ntAssetCache.idle.back();
+		ntAssetCache.idle.pop_back();
+		NtAssetEntry& entry = ntAssetCache.entries[key];
+		ntAssetCache.residentBytes -= entry.bytes;
+		ntAssetCache.owners.erase(entry.asset);
+		NtDeleteAsset(entry.kind, entry.asset);
+		ntAssetCache.entries.erase(key);
+		ntAssetCache.evictions++;
+	}
+}
+
+/// <summary>
+/// Returns a referenced asset for path, parsing the file only if no resident entry has the same content.
+/// Files are read and parsed without holding the cache lock so different assets load concurrently.
+/// </summary>
+/// <param name="kind"></param>
+/// <param name="path"></param>
+/// <param name="asset"></param>
+/// <returns></returns>
+static int NtAcquireAsset(int kind, const std::string& path, void** asset) {
+	//Textures decoded in different layouts are different assets
+	NT_TEXTURE_LAYOUT textureLayout = (NT_TEXTURE_LAYOUT)ntAssetCache.textureLayout.load();
+	int textureTileSize = ntAssetCache.textureTileSize.load();
+	int variant = kind == NT_ASSET_TEXTURE ? kind | (textureLayout << 8) | (textureTileSize << 16) : kind;
+
+	std::error_code error;
+	std::filesystem::path canonicalPath = std::filesystem::weakly_canonical(path, error);
+	std::string pathKey = std::to_string(variant) + ":" + (error ? path : canonicalPath.string());
+	std::filesystem::file_time_type modifiedTime = std::filesystem::last_write_time(path, error);
+	uintmax_t fileSize = error ? 0 : std::filesystem::file_size(path, error);
+	if (error) {
+		NtLog(std::cerr, "File with name " + path + " could not be found\n");
+		return NT_FAILURE;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(ntAssetCache.mutex);
+		auto record = ntAssetCache.paths.find(pathKey);
+		if (record != ntAssetCache.paths.end() && record->second.modifiedTime == modifiedTime && record->second.fileSize == fileSize) {
+			auto entry = ntAssetCache.entries.find(record->second.key);
+			if (entry != ntAssetCache.entries.end()) {
+				ntAssetCache.hits++;
+				*asset = NtReferenceAsset(entry->second);
+				return NT_SUCCESS;
+			}
+		}
+	}
+
+	//Mapped once, the key is hashed from and the asset parsed from the same bytes
+	std::shared_ptr<NtMappedFile> file = std::make_shared<NtMappedFile>();
+	if (!file->Open(path)) {
+		NtLog(std::cerr, "File with name " + path + " could not be read\n");
+		return NT_FAILURE;
+	}
+	unsigned long long key = NtHashAssetBytes(variant, file->Begin(), file->End());
+
+	{
+		//Same content already resident under another path
+		std::lock_guard<std::mutex> lock(ntAssetCache.mutex);
+		ntAssetCache.paths[pathKey] = { modifiedTime, fileSize, key };
+		auto entry = ntAssetCache.entries.find(key);
+		if (entry != ntAssetCache.entries.end()) {
+			ntAssetCache.hits++;
+			*asset = NtReferenceAsset(entry->second);
+			return NT_SUCCESS;
+		}
+	}
+
+	void* loaded = nullptr;
+	size_t bytes = 0;
+	if (kind == NT_ASSET_MESH) {
+		NtMesh* mesh = nullptr;
+		if (NtReadMeshFile(path, file->Begin(), file->End(), &mesh) != NT_SUCCESS) {
+			return NT_FAILURE;
+		}
+		loaded = mesh;
+		bytes = sizeof(NtMesh) + mesh->triangles.capacity() * sizeof(NtTriangle);
+	}
+	else {
+		NtTexture* texture = new NtTexture(path, file->Begin(), file->End(), file, textureLayout, textureTileSize);
+		if (texture->GetHeight() == 0 || texture->GetWidth() == 0) {
+			NtLog(std::cerr, "Failed to load texture: " + path + "\n");
+			delete texture;
+			return NT_FAILURE;
+		}
+		loaded = texture;
+		bytes = texture->GetResidentBytes();
+	}
+
+	std::lock_guard<std::mutex> lock(ntAssetCache.mutex);
+	ntAssetCache.misses++;
+	auto entry = ntAssetCache.entries.find(key);
+	if (entry != ntAssetCache.entries.end()) {
+		//Another thread loaded the same content meanwhile, keep the resident copy
+		NtDeleteAsset(kind, loaded);
+		*asset = NtReferenceAsset(entry->second);
+		return NT_SUCCESS;
+	}
+	NtAssetEntry& created = ntAssetCache.entries[key];
+	created.asset = loaded;
+	created.kind = kind;
+	created.bytes = bytes;
+	created.refCount = 1;
+	ntAssetCache.owners[loaded] = key;
+	ntAssetCache.residentBytes += bytes;
+	NtEvictAssets(ntAssetCache.budgetBytes);
+	*asset = loaded;
+	return NT_SUCCESS;
+}
+
+static int NtReleaseAsset(const void* asset) {
+	std::lock_guard<std::mutex> lock(ntAssetCache.mutex);
+	auto owner = ntAssetCache.owners.find(asset);
+	if (owner == ntAssetCache.owners.end()) {
+		NtLog(std::cerr, "Released an asset the cache does not own\n");
+		return NT_FAILURE;
+	}
+	NtAssetEntry& entry = ntAssetCache.entries[owner->second];
+	if (--entry.refCount == 0) {
+		ntAssetCache.idle.push_front(owner->second);
+		entry.idlePosition = ntAssetCache.idle.begin();
+		NtEvictAssets(ntAssetCache.budgetBytes);
+	}
+	return NT_SUCCESS;
+}
+
+/// <summary>
+/// Returns a shared mesh for a JSON mesh file, every successful acquire must be paired with NtReleaseMesh
+/// </summary>
+/// <param name="path"></param>
+/// <param name="mesh"></param>
+/// <returns></returns>
+int NtAcquireMesh(const std::string& path, NtMesh** mesh) {
+	void* asset = nullptr;
+	int status = NtAcquireAsset(NT_ASSET_MESH, path, &asset);
+	*mesh = (NtMesh*)asset;
+	return status;
+}
+
+/// <summary>
+/// Returns a shared texture for an image file, every successful acquire must be paired with NtReleaseTexture
+/// </summary>
+/// <param name="path"></param>
+/// <param name="texture"></param>
+/// <returns></returns>
+int NtAcquireTexture(const std::string& path, NtTexture** texture) {
+	void* asset = nullptr;
+	int status = NtAcquireAsset(NT_ASSET_TEXTURE, path, &asset);
+	*texture = (NtTexture*)asset;
+	return status;
+}
+
+int NtReleaseMesh(const NtMesh* mesh) {
+	return NtReleaseAsset(mesh);
+}
+
+int NtReleaseTexture(const NtTexture* texture) {
+	return NtReleaseAsset(texture);
+}
+
+/// <summary>
+/// Sets the layout textures decoded by the cache are stored in, textures already resident keep theirs.
+/// .ntx containers are sampled in the layout they were written with.
+/// </summary>
+/// <param name="layout"></param>
+/// <param name="tileSize">Power of two from 2 to 64, only used by NT_TEXTURE_TILED</param>
+/// <returns></returns>
+int NtSetTextureLayout(NT_TEXTURE_LAYOUT layout, int tileSize) {
+	if (layout < NT_TEXTURE_LINEAR || layout > NT_TEXTURE_MORTON || tileSize < 2 || tileSize > 64 || (tileSize & (tileSize - 1)) != 0) {
+		NtLog(std::cerr, "NtSetTextureLayout: Invalid layout or tile size\n");
+		return NT_FAILURE;
+	}
+	ntAssetCache.textureLayout = layout;
+	ntAssetCache.textureTileSize = tileSize;
+	return NT_SUCCESS;
+}
+
+/// <summary>
+/// Sets how many bytes of assets may stay resident, unreferenced assets beyond it are evicted immediately
+/// </summary>
+/// <param name="budgetBytes"></param>
+void NtSetAssetCacheBudget(size_t budgetBytes) {
+	std::lock_guard<std::mutex> lock(ntAssetCache.mutex);
+	ntAssetCache.budgetBytes = budgetBytes;
+	NtEvictAssets(budgetBytes);
+}
+
+/// <summary>
+/// Frees every asset no scene references
+/// </summary>
+void NtTrimAssetCache() {
+	std::lock_guard<std::mutex> lock(ntAssetCache.mutex);
+	NtEvictAssets(0);
+}
+
+NtAssetCacheStats NtGetAssetCacheStats() {
+	std::lock_guard<std::mutex> lock(ntAssetCache.mutex);
+	NtAssetCacheStats stats;
+	stats.residentBytes = ntAssetCache.residentBytes;
+	stats.budgetBytes = ntAssetCache.budgetBytes;
+	for (const auto& entry : ntAssetCache.entries) {
+		if (entry.second.kind == NT_ASSET_MESH) stats.meshCount++;
+		else stats.textureCount++;
+	}
+	stats.idleCount = (int)ntAssetCache.idle.size();
+	stats.hits = ntAssetCache.hits;
+	stats.misses = ntAssetCache.misses;
+	stats.evictions = ntAssetCache.evictions;
+	return stats;
+}
+
+/// <summary>
+/// Releases the scene's meshes and textures back to the asset cache and deletes the scene.
+/// Only for scenes that own their references, i.e. ones filled by NtLoadSceneJSON/NtLoadMesh/NtLoadTexture, not copies.
+/// </summary>
+/// <param name="scene"></param>
+/// <returns></returns>
+int NtFreeScene(NtScene* scene) {
+	if (nullptr == scene) {
+		return NT_FAILURE;
+	}
+	int status = NT_SUCCESS;
+	for (auto& mesh : scene->meshMap) {
+		status |= NtReleaseMesh(mesh.second);
+	}
+	for (auto& texture : scene->textureMap) {
+		status |= NtReleaseTexture(texture.second);
+	}
+	delete scene;
+	return status;
+}
+
+/// <summary>
+/// Returns the unnormalized reconstruction filter weight of a sample at the given offset from pixel center
+/// </summary>
+/// <param name="filter"></param>
+/// <param name="shiftX"></param>
+/// <param name="shiftY"></param>
+/// <returns></returns>
+float NtAAFilterWeight(NT_AA_FILTER filter, float shiftX, float shiftY) {
+	switch (filter) {
+	case NT_AA_FILTER_TENT:
+		//Separable tent with a radius of one pixel
+		return Max(1 - std::fabs(shiftX), 0) * Max(1 - std::fabs(shiftY), 0);
+	case NT_AA_FILTER_GAUSSIAN:
+		return std::exp(-(shiftX * shiftX + shiftY * shiftY) / (2 * NT_AA_GAUSSIAN_SIGMA * NT_AA_GAUSSIAN_SIGMA));
+	default:
+		return 1.0f;
+	}
+}
+
+/// <summary>
+/// Generates count Poisson disk offsets in [-0.5, 0.5) with Mitchell's best candidate algorithm.
+/// Seeded and driven by raw mt19937 output so the pattern is identical on every platform.
+/// </summary>
+/// <param name="count"></param>
+/// <param name="shifts"></param>
+static void NtGeneratePoissonShifts(int count, std::vector<NtAAShift>& shifts) {
+	const int candidatesPerSample = 16;
+	std::mt19937 rng(580);
+	auto next = [&rng]() { return rng() / 4294967296.0f - 0.5f; };
+
+	for (int i = 0; i < count; i++) {
+		NtAAShift best = { 0, 0, 0 };
+		float bestDistance = -1;
+		for (int c = 0; c < candidatesPerSample * (i + 1); c++) {
+			NtAAShift candidate = { next(), next(), 0 };
+			float minDistance = INFINITY;
+			for (int j = 0; j < i; j++) {
+				float dx = candidate.shiftX - shifts[j].shiftX;
+				float dy = candidate.shiftY - shifts[j].shiftY;
+				minDistance = Min(minDistance, dx * dx + dy * dy);
+			}
+			if (minDistance > bestDistance) {
+				bestDistance = minDistance;
+				best = candidate;
+			}
+		}
+		shifts[i] = best;
+	}
+}
+
+/// <summary>
+/// Loads anti-aliasing sample pattern and reconstruction filter into display for display->sampleCount samples.
+/// Legacy pattern supports exactly 6 samples and keeps its hand tuned weights, other patterns support 1, 2, 4, 8, 16.
+/// </summary>
+/// <param name="display"></param>
+/// <param name="pattern"></param>
+/// <param name="filter"></param>
+/// <returns></returns>
+int NtLoadAAFilter(NtDisplay* display, NT_AA_PATTERN pattern, NT_AA_FILTER filter) {
+	if (display == nullptr) return NT_FAILURE;
+	int count = display->sampleCount;
+	display->aaShifts.clear();
+	if (count <= 0) return NT_SUCCESS;
+
+	if (pattern == NT_AA_PATTERN_LEGACY) {
+		if (count != 6) {
+			NtLog(std::cerr, "NtLoadAAFilter: legacy pattern requires 6 samples, got " + std::to_string(count) + "\n");
+			return NT_FAILURE;
+		}
+		display->aaShifts = {
+			{ -0.52, 0.38, 0.128 },
+			{ 0.41, 0.56, 0.119 },
+			{ 0.27,  0.08, 0.294 },
+			{ -0.17, -0.29, 0.249 },
+			{ 0.58, -0.55, 0.104 },
+			{ -0.31, -0.71, 0.106 }
+		};
+		return NT_SUCCESS;
+	}
+
+	if (count > NT_AA_MAX_SAMPLES || (count & (count - 1)) != 0) {
+		NtLog(std::cerr, "NtLoadAAFilter: unsupported sample count " + std::to_string(count) + ", use a power of two up to " +
+			std::to_string(NT_AA_MAX_SAMPLES) + "\n");
+		return NT_FAILURE;
+	}
+
+	display->aaShifts.resize(count);
+	if (pattern == NT_AA_PATTERN_ROTATED_GRID) {
+		//Standard multisample positions in 1/16 pixel units
+		static const int grid1[][2] = { {0, 0} };
+		static const int grid2[][2] = { {4, 4}, {-4, -4} };
+		static const int grid4[][2] = { {-2, -6}, {6, -2}, {-6, 2}, {2, 6} };
+		static const int grid8[][2] = { {1, -3}, {-1, 3}, {5, 1}, {-3, -5}, {-5, 5}, {-7, -1}, {3, 7}, {7, -7} };
+		static const int grid16[][2] = { {1, 1}, {-1, -3}, {-3, 2}, {4, -1}, {-5, -2}, {2, 5}, {5, 3}, {3, -5},
+			{-2, 6}, {0, -7}, {-4, -6}, {-6, 4}, {-8, 0}, {7, -4}, {6, 7}, {-7, -8} };
+		const int(*grid)[2] = count == 1 ? grid1 : count == 2 ? grid2 : count == 4 ? grid4 : count == 8 ? grid8 : grid16;
+		for (int i = 0; i < count; i++) {
+			display->aaShifts[i] = { grid[i][0] / 16.0f, grid[i][1] / 16.0f, 0 };
+		}
+	}
+	else {
+		NtGeneratePoissonShifts(count, display->aaShifts);
+	}
+
+	//Weight each sample by the reconstruction filter, normalized to sum to 1
+	float weightSum = 0;
+	for (NtAAShift& shift : display->aaShifts) {
+		shift.weight = NtAAFilterWeight(filter, shift.shiftX, shift.shiftY);
+		weightSum += shift.weight;
+	}
+	for (NtAAShift& shift : display->aaShifts) {
+		shift.weight /= weightSum;
+	}
+
+	return NT_SUCCESS;
+}
+
+/// <summary>
+/// Builds the matrix of a scale, rotation and translation, and its inverse
+/// </summary>
+/// <param name="transformation"></param>
+/// <param name="matrix"></param>
+/// <param name="inverse"></param>
+static void NtTransformationMatrices(const NtTransformation& transformation, NtMatrix& matrix, NtMatrix& inverse) {
+	//Load transformation matrix
+	NtMatrix zRot;
+	NtRotZMat(transformation.rotation.z, zRot);
+	NtMatrix yRot;
+	NtRotYMat(transformation.rotation.y, yRot);
+	NtMatrix xRot;
+	NtRotXMat(transformation.rotation.x, xRot);
+
+	NtMatrix combinedRotation = zRot * yRot * xRot;
+	NtMatrix combinedRotationInversed;
+	NtInvertRotMat(combinedRotation, combinedRotationInversed);
+
+	NtMatrix scale;
+	NtScaleMat(transformation.scale, scale);
+	NtMatrix scaleInversed;
+	NtInvertScaleMat(scale, scaleInversed);
+
+	NtMatrix translation;
+	NtTranslateMat(transformation.translation, translation);
+	NtMatrix translationInversed;
+	NtInvertTranslateMat(translation, translationInversed);
+
+	//Forward transformation order is scale -> rotation -> translation
+	//But matrix multiplication first multiplied is last applied
+
+	//For inverse transformation, the order is reversed forward
+	matrix = translation * combinedRotation * scale;
+	inverse = scaleInversed * combinedRotationInversed * translationInversed;
+}
+
+static bool NtSameTransformation(const NtTransformation& a, const NtTransformation& b) {
+	return a.scale.x == b.scale.x && a.scale.y == b.scale.y && a.scale.z == b.scale.z &&
+		a.rotation.x == b.rotation.x && a.rotation.y == b.rotation.y && a.rotation.z == b.rotation.z &&
+		a.translation.x == b.translation.x && a.translation.y == b.translation.y && a.translation.z == b.translation.z;
+}
+
+/// <summary>
+/// Brings every shape's cached world and normal matrix up to date. Parents precede their children in scene->shapes,
+/// so one pass in order rebuilds a moved node and then its whole subtree while untouched nodes are skipped.
+/// A child's world matrix is its parent's world matrix times its own, its inverse the reverse product of the inverses.
+/// </summary>
+/// <param name="scene"></param>
+/// <param name="updatedCount">Optional, receives the number of nodes rebuilt</param>
+/// <returns></returns>
+int NtUpdateSceneGraph(NtScene* scene, int* updatedCount) {
+	if (scene == nullptr) return NT_FAILURE;
+	int updated = 0;
+	scene->nodes.resize(scene->shapes.size());
+	for (size_t i = 0; i < scene->shapes.size(); i++) {
+		const NtShape& shape = scene->shapes[i];
+		NtSceneNode& node = scene->nodes[i];
+		if (shape.parent >= static_cast<int>(i)) {
+			NtLog(std::cerr, "NtUpdateSceneGraph: shape " + shape.id + " must come after its parent\n");
+			return NT_FAILURE;
+		}
+		const NtSceneNode* parent = shape.parent >= 0 ? &scene->nodes[shape.parent] : nullptr;
+		node.changed = node.dirty || node.parent != shape.parent || !NtSameTransformation(node.transforms, shape.transforms) ||
+			(parent != nullptr && parent->changed);
+		if (!node.changed) continue;
+
+		NtTransformationMatrices(shape.transforms, node.world, node.worldInverse);
+		if (parent != nullptr) {
+			node.world = parent->world * node.world;
+			node.worldInverse = node.worldInverse * parent->worldInverse;
+		}
+		node.transforms = shape.transforms;
+		node.parent = shape.parent;
+		node.dirty = false;
+		updated++;
+	}
+	if (updatedCount != nullptr) *updatedCount = updated;
+	return NT_SUCCESS;
+}
+
+//Instances whose vertices are transformed together, one SIMD lane each. A multiple of 4.
+#define NT_INSTANCE_BATCH 16
+
+//Per instance matrices laid out one element per row with a lane per instance, so a vertex is transformed for the
+//whole batch with the same element of every matrix in one register
+typedef struct NtInstanceBatch {
+	alignas(16) float clip[16][NT_INSTANCE_BATCH]; //Object to clip space, projection * view * world
+	alignas(16) float normal[12][NT_INSTANCE_BATCH]; //Object to camera space normals, view * world inverse, 3 rows
+	int count = 0;
+} NtInstanceBatch;
+
+/// <summary>
+/// Transforms one point or direction by rowCount rows of every matrix in a batch, out[row][lane].
+/// Unused lanes hold zero matrices and are transformed along with the rest.
+/// </summary>
+/// <param name="rows">First element of the first row, 4 elements per row</param>
+/// <param name="rowCount"></param>
+/// <param name="p"></param>
+/// <param name="w">1 for points, 0 for directions</param>
+/// <param name="out"></param>
+static void NtTransformInstanceLanes(const float(*rows)[NT_INSTANCE_BATCH], int rowCount, const Vector3& p, float w, float(*out)[NT_INSTANCE_BATCH]) {
+	for (int row = 0; row < rowCount; row++) {
+		const float* m0 = rows[row * 4];
+		const float* m1 = rows[row * 4 + 1];
+		const float* m2 = rows[row * 4 + 2];
+		const float* m3 = rows[row * 4 + 3];
+		int lane = 0;
+#ifdef NT_HAS_SSE2
+		__m128 x = _mm_set1_ps(p.x);
+		__m128 y = _mm_set1_ps(p.y);
+		__m128 z = _mm_set1_ps(p.z);
+		__m128 wide = _mm_set1_ps(w);
+		for (; lane < NT_INSTANCE_BATCH; lane += 4) {
+			__m128 sum = _mm_add_ps(_mm_mul_ps(_mm_load_ps(m0 + lane), x), _mm_mul_ps(_mm_load_ps(m1 + lane), y));
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_load_ps(m2 + lane), z));
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_load_ps(m3 + lane), wide));
+			_mm_store_ps(out[row] + lane, sum);
+		}
+#endif
+		for (; lane < NT_INSTANCE_BATCH; lane++) {
+			out[row][lane] = m0[lane] * p.x + m1[lane] * p.y + m2[lane] * p.z + m3[lane] * w;
+		}
+	}
+}
+
+/// <summary>
+/// Draws every instance of a shape into every given render. Instances are transformed in batches of NT_INSTANCE_BATCH:
+/// each triangle of the mesh is read once per batch, its vertices transformed for all instances of the batch at once and
+/// then submitted per instance, so the mesh is streamed once per batch instead of once per instance.
+/// </summary>
+/// <param name="shape"></param>
+/// <param name="node">The shape's scene graph node, its world matrix applies after each instance's transforms</param>
+/// <param name="mesh"></param>
+/// <param name="renders"></param>
+static void NtDrawInstances(const NtShape& shape, const NtSceneNode& node, const NtMesh& mesh, const std::vector<NtRender*>& renders) {
+	//Every render of a frame shares the context camera
+	const NtCamera* camera = renders[0]->camera;
+	NtMatrix viewProjection = camera->projectMatrix * camera->viewMatrix;
+	NtInstanceBatch batch;
+	alignas(16) float clip[3][4][NT_INSTANCE_BATCH];
+	alignas(16) float normal[3][3][NT_INSTANCE_BATCH];
+
+	for (size_t first = 0; first < shape.instances.size(); first += NT_INSTANCE_BATCH) {
+		batch.count = static_cast<int>(std::min<size_t>(NT_INSTANCE_BATCH, shape.instances.size() - first));
+		std::memset(batch.clip, 0, sizeof(batch.clip));
+		std::memset(batch.normal, 0, sizeof(batch.normal));
+		for (int lane = 0; lane < batch.count; lane++) {
+			NtMatrix local;
+			NtMatrix localInverse;
+			NtTransformationMatrices(shape.instances[first + lane].transforms, local, localInverse);
+			NtMatrix clipMatrix = viewProjection * (node.world * local);
+			NtMatrix normalMatrix = camera->viewMatrix * (localInverse * node.worldInverse);
+			for (int element = 0; element < 16; element++) {
+				batch.clip[element][lane] = clipMatrix.m[element / 4][element % 4];
+			}
+			for (int element = 0; element < 12; element++) {
+				batch.normal[element][lane] = normalMatrix.m[element / 4][element % 4];
+			}
+		}
+
+		for (const NtTriangle& triangle : mesh.triangles) {
+			const NtVertex* vertices[3] = { &triangle.v0, &triangle.v1, &triangle.v2 };
+			for (int i = 0; i < 3; i++) {
+				NtTransformInstanceLanes(batch.clip, 4, vertices[i]->vertexPos, 1, clip[i]);
+				NtTransformInstanceLanes(batch.normal, 3, vertices[i]->vertexNormal, 0, normal[i]);
+			}
+			for (int lane = 0; lane < batch.count; lane++) {
+				const NtMaterial& material = shape.instances[first + lane].material;
+				for (NtRender* render : renders) {
+					//The rasterizer writes its inputs, every render gets a fresh copy
+					Vector4 clipList[3];
+					Vector3 normalList[3];
+					Vector2 uvList[3];
+					for (int i = 0; i < 3; i++) {
+						clipList[i] = Vector4(clip[i][0][lane], clip[i][1][lane], clip[i][2][lane], clip[i][3][lane]);
+						normalList[i] = Vector3(normal[i][0][lane], normal[i][1][lane], normal[i][2][lane]);
+						uvList[i] = vertices[i]->texture;
+					}
+					NtPutTransformedTriangle(render, clipList, normalList, uvList, material);
+				}
+			}
+		}
+	}
+}
+
+/// <summary>
+/// Puts all of each shape's triangles into every given render with the shape's cached world matrix, or once per
+/// instance for instanced shapes. Triangles are submitted to all renders back to back so the mesh stays hot in cache.
+/// scene->nodes must be up to date, see NtUpdateSceneGraph.
+/// </summary>
+/// <param name="scene"></param>
+/// <param name="renders"></param>
+static void NtDrawShapes(const NtScene* scene, const std::vector<NtRender*>& renders) {
+	for (size_t i = 0; i < scene->shapes.size(); i++) {
+		const NtShape& shape = scene->shapes[i];
+		//Render faces of that model, lookup never inserts so the scene stays read only
+		auto meshIt = scene->meshMap.find(shape.geometryId);
+		if (meshIt == scene->meshMap.end() || meshIt->second == nullptr) continue;
+		NT_TRACE_SCOPE("NtDrawShape", shape.id.c_str());
+		if (!shape.instances.empty()) {
+			NtDrawInstances(shape, scene->nodes[i], *meshIt->second, renders);
+			continue;
+		}
+		NtMatrix world = scene->nodes[i].world;
+		NtMatrix worldInverse = scene->nodes[i].worldInverse;
+		for (NtRender* render : renders) {
+			NtSetWorldMatrix(render, world, worldInverse);
+		}
+		for (NtTriangle& triangle : meshIt->second->triangles) {
+			for (NtRender* render : renders) {
+				NtPutTriangle(render, triangle, shape.material);
+			}
+		}
+	}
+}
+
+/// <summary>
+/// Renders a scene, handles the other stuff automatically.
+/// One-shot wrapper that allocates a render context for this frame only, use a persistent context for many frames.
+/// </summary>
+/// <param name="scene"></param>
+/// <param name="outputName"></param>
+/// <returns></returns>
+int NtRenderScene(NtScene* scene, const std::string outputName, NT_SHADING_MODE shadingMode) {
+	NtRenderContext* context;
+	int status = NtNewRenderContext(&context);
+	status |= NtRenderScene(context, scene, outputName, shadingMode);
+	status |= NtFreeRenderContext(context);
+	return status ? NT_FAILURE : NT_SUCCESS;
+}
+
+/// <summary>
+/// Renders a scene using the context's buffers, which are reused when resolution and sample count are unchanged.
+/// An empty outputName skips the flush and leaves the frame in context->display->frameBuffer.
+/// A heatmap context->debugView draws one sample per pixel and replaces the image with the heatmap before the flush.
+/// </summary>
+/// <param name="context"></param>
+/// <param name="scene"></param>
+/// <param name="outputName"></param>
+/// <param name="shadingMode"></param>
+/// <returns></returns>
+int NtRenderScene(NtRenderContext* context, NtScene* scene, const std::string outputName, NT_SHADING_MODE shadingMode) {
+	if (context == nullptr || scene == nullptr) return NT_FAILURE;
+	NT_STATS(double timeStart = NtStatsSeconds());
+	NT_TRACE_SCOPE("NtRenderScene", outputName.c_str());
+	int status = 0;
+	//Heatmaps count what one sample per pixel sees, anti-aliasing would multiply and blur the counts
+	bool heatmapView = context->debugView != NT_VIEW_SHADED;
+	NtAASettings aa = scene->aaSettings;
+	if (heatmapView) {
+		aa.sampleCount = 0;
+		aa.mode = NT_AA_SUPERSAMPLE;
+	}
+	status |= NtPrepareRenderContext(context, scene->camera.xRes, scene->camera.yRes, aa);
+	if (status) return NT_FAILURE;
+	if (heatmapView) status |= NtResetHeatmap(context->heatmap, scene->camera.xRes, scene->camera.yRes);
+	context->render->heatmap = heatmapView ? &context->heatmap : nullptr;
+
+	NtRenderStats& stats = context->stats;
+	stats = NtRenderStats();
+	stats.frame = context->frameCount++;
+	stats.xRes = scene->camera.xRes;
+	stats.yRes = scene->camera.yRes;
+	NT_STATS(stats.stageSeconds[NT_STAGE_LOAD] = scene->loadSeconds);
+	NT_STATS(context->render->stats = &stats);
+	NT_STATS(for (NtRender* render : context->sampleRenders) render->stats = &stats);
+
+	NtDisplay* displayPtr = context->display;
+	NtRender* renderPtr = context->render;
+	std::vector<NtRender*>& sampleRenders = context->sampleRenders;
+	//Camera matrices are derived into the context so concurrent frames can share one scene
+	NtCamera& camera = context->camera;
+	camera = scene->camera;
+	for (NtRender* render : sampleRenders) {
+		status |= NtSetRenderAttributes(render, scene);
+		status |= NtSetShadingMode(render, shadingMode);
+		status |= NtPutCamera(render, camera);
+	}
+	status |= NtSetRenderAttributes(renderPtr, scene);
+	status |= NtSetShadingMode(renderPtr, shadingMode);
+	//Put camera and matrix
+	status |= NtPutCamera(renderPtr, camera);
+	if (status) return NT_FAILURE;
 
 	//Calculate camerae matrix, we need to calculate u, v, n, r
-	Vector3 n = (scene->camera.from - scene->camera.to);
+	Vector3 n = (camera.from - camera.to);
 	n.normalize();
-	scene->camera.viewDirection = n;
+	camera.viewDirection = n;
 	//Assume world up
 	Vector3 worldUp = { 0, 1, 0 };
 
@@ -1066,74 +4181,544 @@ int NtRenderScene(NtScene* scene, const std::string outputName, NT_SHADING_MODE
 
 	Vector3 v = n.cross(u);
 
-	Vector3 r = scene->camera.from;
-
-	status |= NtCalculateViewMatrix(scene->camera, u, v, n, r);
-	status |= NtCalculateProjectionMatrix(scene->camera, scene->camera.near, scene->camera.far, scene->camera.top, scene->camera.bottom, scene->camera.left, scene->camera.right);
-
-	//Render each shape, each time computing the new transformation (world matrix) and put triangle
-	for (auto& shape : scene->shapes) {
-		//Load transformation matrix
-		NtMatrix zRot;
-		NtRotZMat(shape.transforms.rotation.z, zRot);
-		NtMatrix yRot;
-		NtRotYMat(shape.transforms.rotation.y, yRot);
-		NtMatrix xRot;
-		NtRotXMat(shape.transforms.rotation.x, xRot);
-
-		NtMatrix combinedRotation = zRot * yRot * xRot;
-		NtMatrix combinedRotationInversed;
-		NtInvertRotMat(combinedRotation, combinedRotationInversed);
-
-		NtMatrix scale;
-		NtScaleMat(shape.transforms.scale, scale);
-		NtMatrix scaleInversed;
-		NtInvertScaleMat(scale, scaleInversed);
-
-		NtMatrix translation;
-		NtTranslateMat(shape.transforms.translation, translation);
-		NtMatrix translationInversed;
-		NtInvertTranslateMat(translation, translationInversed);
-
-		//Forward transformation order is scale -> rotation -> translation
-		//But matrix multiplication first multiplied is last applied
-
-		//For inverse transformation, the order is reversed forward
-		NtMatrix combinedTransformation = translation * combinedRotation * scale;
-		NtMatrix combinedTransformationInversed = scaleInversed * combinedRotationInversed * translationInversed;
-		combinedRotationInversed.transpose();
-		NtSetWorldMatrix(renderPtr, combinedTransformation, combinedTransformationInversed);
-		for (int i = 0; i < sampleRenders.size(); i++) {
-			NtSetWorldMatrix(sampleRenders[i], combinedTransformation, combinedTransformationInversed);
-		}
-		//Render faces of that model
-		NtMesh* mesh = scene->meshMap[shape.geometryId];
-		for (NtTriangle& triangle : mesh->triangles) {
-			if (displayPtr->sampleCount <= 0) {
-				//No anti-aliasing, render to frame buffer directly
-				NtPutTriangle(renderPtr, triangle, shape.material);
-			}
-			else {
-				for (int i = 0; i < sampleRenders.size(); i++) {
-					NtPutTriangle(sampleRenders[i], triangle, shape.material);
-				}
-			}
+	Vector3 r = camera.from;
+
+	status |= NtCalculateViewMatrix(camera, u, v, n, r);
+	status |= NtCalculateProjectionMatrix(camera, camera.near, camera.far, camera.top, camera.bottom, camera.left, camera.right);
+
+	//Only shapes whose transforms or ancestors changed since the last frame get new world matrices
+	status |= NtUpdateSceneGraph(scene, &stats.nodesUpdated);
+	if (status) return NT_FAILURE;
+
+	//Render each shape into the main render, or into every sample render for anti-aliasing
+	NT_STATS(double timeDraw = NtStatsSeconds(), timeResolve = 0);
+	if (displayPtr->sampleCount <= 0) {
+		//No anti-aliasing, render to frame buffer directly
+		NtDrawShapes(scene, { renderPtr });
+		stats.renderCount = 1;
+		NT_STATS(timeResolve = NtStatsSeconds());
+		if (aa.mode == NT_AA_FXAA) {
+			status |= NtApplyFXAA(displayPtr, aa.fxaaEdgeThreshold, aa.fxaaEdgeThresholdMin, aa.fxaaSubpixelQuality);
+		}
+		if (heatmapView) {
+			renderPtr->heatmap = nullptr;
+			status |= NtWriteHeatmap(displayPtr, context->heatmap, context->debugView);
 		}
 	}
+	else if (aa.mode == NT_AA_ADAPTIVE) {
+		//Single sample pass at pixel centers, then supersample only pixels on a discontinuity
+		status |= NtNewIdBuffer(renderPtr);
+		NtDrawShapes(scene, { renderPtr });
+
+		NT_STATS(double timeDetect = NtStatsSeconds());
+		NtAAEdgeMask& edgeMask = context->edgeMask;
+		status |= NtDetectAAEdges(renderPtr, aa.edgeDepthThreshold, aa.edgeColorThreshold, edgeMask);
+		for (NtRender* sampleRender : sampleRenders) {
+			sampleRender->edgeMask = &edgeMask;
+		}
+		NT_STATS(double detectSeconds = NtStatsSeconds() - timeDetect);
+		NT_STATS(stats.stageSeconds[NT_STAGE_RESOLVE] += detectSeconds, timeDraw += detectSeconds);
+		NtDrawShapes(scene, sampleRenders);
+		stats.renderCount = 1 + (int)sampleRenders.size();
+		NT_STATS(timeResolve = NtStatsSeconds());
+		status |= NtAverageSampleToFrameBuffer(displayPtr, &edgeMask);
+		for (NtRender* sampleRender : sampleRenders) {
+			sampleRender->edgeMask = nullptr;
+		}
+	}
+	else {
+		NtDrawShapes(scene, sampleRenders);
+		stats.renderCount = (int)sampleRenders.size();
+		NT_STATS(timeResolve = NtStatsSeconds());
+		status |= NtAverageSampleToFrameBuffer(displayPtr);
+	}
 
-	status |= NtAverageSampleToFrameBuffer(displayPtr);
+#if NT_RENDER_STATS
+	//Per triangle stages were timed on every NT_STATS_TIMING_INTERVAL-th triangle, where the clock reads themselves
+	//inflate the time. The sample only gives their split, which is applied to the measured drawing time.
+	double timeFlush = NtStatsSeconds();
+	stats.stageSeconds[NT_STAGE_RESOLVE] += timeFlush - timeResolve;
+	double sampledSeconds = stats.stageSeconds[NT_STAGE_TRANSFORM] + stats.stageSeconds[NT_STAGE_RASTER] + stats.stageSeconds[NT_STAGE_SHADE];
+	if (sampledSeconds > 0) {
+		double scale = (timeResolve - timeDraw) / sampledSeconds;
+		stats.stageSeconds[NT_STAGE_TRANSFORM] *= scale;
+		stats.stageSeconds[NT_STAGE_RASTER] *= scale;
+		stats.stageSeconds[NT_STAGE_SHADE] *= scale;
+	}
+	stats.frameSeconds = timeFlush - timeStart;
+#endif
+	if (outputName.empty()) return status ? NT_FAILURE : NT_SUCCESS;
 
 	//Flush to ppm
 	FILE* outfile = NULL;
 	errno_t errOutfile = fopen_s(&outfile, outputName.c_str(), "wb");
 	if (errOutfile != 0 || outfile == NULL) {
-		std::cout << "Failed to open output file: " << outputName << "\n";
+		NtLog(std::cout, "Failed to open output file: " + outputName + "\n");
+		return NT_FAILURE;
+	}
+	status |= NtFlushDisplayBufferPPM(outfile, displayPtr);
+	fclose(outfile);
+#if NT_RENDER_STATS
+	double timeDone = NtStatsSeconds();
+	stats.stageSeconds[NT_STAGE_FLUSH] = timeDone - timeFlush;
+	stats.frameSeconds = timeDone - timeStart;
+#endif
+	if (context->writeStats) {
+		status |= NtWriteRenderStatsJSON(std::filesystem::path(outputName).replace_extension(".stats.json").string(), stats);
+	}
+	return status ? NT_FAILURE : NT_SUCCESS;
+}
+
+/// <summary>
+/// Allocates an empty render context, buffers are created by the first NtPrepareRenderContext or NtRenderScene
+/// </summary>
+/// <param name="context"></param>
+/// <returns></returns>
+int NtNewRenderContext(NtRenderContext** context) {
+	if (context == nullptr) return NT_FAILURE;
+	*context = new NtRenderContext();
+	return NT_SUCCESS;
+}
+
+/// <summary>
+/// Readies the context for a frame. Display and renders are reallocated only when resolution or sample count changed,
+/// otherwise they are cleared in place. The sample pattern is reloaded every time since it is cheap.
+/// </summary>
+/// <param name="context"></param>
+/// <param name="xRes"></param>
+/// <param name="yRes"></param>
+/// <param name="aaSettings"></param>
+/// <returns></returns>
+int NtPrepareRenderContext(NtRenderContext* context, int xRes, int yRes, const NtAASettings& aaSettings) {
+	if (context == nullptr || xRes <= 0 || yRes <= 0) return NT_FAILURE;
+	int status = 0;
+	//FXAA is a post-process on a single sample render, no sample buffers needed
+	int sampleCount = aaSettings.mode == NT_AA_FXAA ? 0 : std::max(aaSettings.sampleCount, 0);
+
+	NtDisplay* display = context->display;
+	bool reallocate = display == nullptr || display->xRes != xRes || display->yRes != yRes || display->sampleCount != sampleCount;
+	if (reallocate) {
+		//Release old buffers before allocating so peak memory stays at one resolution
+		NtDisplay* oldDisplay = context->display;
+		context->display = nullptr;
+		for (NtRender* render : context->sampleRenders) {
+			NtFreeRender(render);
+		}
+		context->sampleRenders.clear();
+		if (context->render != nullptr) {
+			NtFreeRender(context->render);
+			context->render = nullptr;
+		}
+		if (oldDisplay != nullptr) {
+			NtFreeDisplay(oldDisplay);
+		}
+
+		status |= NtNewDisplay(&context->display, xRes, yRes, context->backgroundColor, sampleCount, aaSettings.pattern, aaSettings.filter);
+		status |= NtNewRender(&context->render, context->display);
+		context->sampleRenders.resize(sampleCount);
+		for (int i = 0; i < sampleCount; i++) {
+			status |= NtNewRender(&context->sampleRenders[i], context->display, i);
+		}
+		return status ? NT_FAILURE : NT_SUCCESS;
+	}
+
+	status |= NtClearDisplay(display, context->backgroundColor, context->fastClear);
+	status |= NtLoadAAFilter(display, aaSettings.pattern, aaSettings.filter);
+	status |= NtClearRender(context->render);
+	for (NtRender* render : context->sampleRenders) {
+		status |= NtClearRender(render);
+	}
+	return status ? NT_FAILURE : NT_SUCCESS;
+}
+
+/// <summary>
+/// Frees the context and every buffer it owns
+/// </summary>
+/// <param name="context"></param>
+/// <returns></returns>
+int NtFreeRenderContext(NtRenderContext* context) {
+	if (context == nullptr) return NT_FAILURE;
+	for (NtRender* render : context->sampleRenders) {
+		NtFreeRender(render);
+	}
+	if (context->render != nullptr) {
+		NtFreeRender(context->render);
+	}
+	if (context->display != nullptr) {
+		NtFreeDisplay(context->display);
+	}
+	delete context;
+	return NT_SUCCESS;
+}
+
+/// <summary>
+/// Shaded fragments per covered pixel, 1 when every covered pixel was shaded exactly once
+/// </summary>
+/// <param name="stats"></param>
+/// <returns>0 when nothing was covered</returns>
+float NtOverdrawRatio(const NtRenderStats& stats) {
+	return stats.samplesCovered > 0 ? (float)((double)stats.fragmentsShaded / stats.samplesCovered) : 0;
+}
+
+/// <summary>
+/// Serializes frame statistics as a JSON object, stage times in milliseconds
+/// </summary>
+/// <param name="stats"></param>
+/// <returns></returns>
+std::string NtRenderStatsJSON(const NtRenderStats& stats) {
+	static const char* stageNames[NT_STAGE_COUNT] = { "load", "transform", "raster", "shade", "resolve", "flush" };
+	nlohmann::json stages;
+	for (int stage = 0; stage < NT_STAGE_COUNT; stage++) {
+		stages[stageNames[stage]] = stats.stageSeconds[stage] * 1000;
+	}
+	nlohmann::json output = {
+		{ "enabled", NT_RENDER_STATS != 0 },
+		{ "frame", stats.frame },
+		{ "resolution", { stats.xRes, stats.yRes } },
+		{ "renders", stats.renderCount },
+		{ "trianglesSubmitted", stats.trianglesSubmitted },
+		{ "trianglesCulled", stats.trianglesCulled },
+		{ "trianglesRasterized", stats.trianglesRasterized },
+		{ "pixelsTested", stats.pixelsTested },
+		{ "depthPasses", stats.depthPasses },
+		{ "fragmentsShaded", stats.fragmentsShaded },
+		{ "textureFetches", stats.textureFetches },
+		{ "samplesCovered", stats.samplesCovered },
+		{ "overdraw", NtOverdrawRatio(stats) },
+		{ "timedTriangles", stats.timedTriangles },
+		{ "nodesUpdated", stats.nodesUpdated },
+		{ "stageMilliseconds", stages },
+		{ "frameMilliseconds", stats.frameSeconds * 1000 }
+	};
+	return output.dump(2);
+}
+
+/// <summary>
+/// Writes frame statistics to a JSON file
+/// </summary>
+/// <param name="path"></param>
+/// <param name="stats"></param>
+/// <returns></returns>
+int NtWriteRenderStatsJSON(const std::string& path, const NtRenderStats& stats) {
+	std::ofstream file(path);
+	if (!file.is_open()) {
+		NtLog(std::cerr, "Failed to write render statistics " + path + "\n");
+		return NT_FAILURE;
+	}
+	file << NtRenderStatsJSON(stats) << "\n";
+	return file ? NT_SUCCESS : NT_FAILURE;
+}
+
+/// <summary>
+/// Sizes the heatmap for a resolution and zeroes every counter, storage is kept when the resolution is unchanged
+/// </summary>
+/// <param name="heatmap"></param>
+/// <param name="xRes"></param>
+/// <param name="yRes"></param>
+/// <returns></returns>
+int NtResetHeatmap(NtHeatmap& heatmap, int xRes, int yRes) {
+	if (xRes <= 0 || yRes <= 0) return NT_FAILURE;
+	heatmap.xRes = xRes;
+	heatmap.yRes = yRes;
+	heatmap.tileCountX = (xRes + NT_HEATMAP_TILE_SIZE - 1) / NT_HEATMAP_TILE_SIZE;
+	heatmap.tileCountY = (yRes + NT_HEATMAP_TILE_SIZE - 1) / NT_HEATMAP_TILE_SIZE;
+	size_t pixelCount = (size_t)xRes * yRes;
+	size_t tileCount = (size_t)heatmap.tileCountX * heatmap.tileCountY;
+	heatmap.fragments.assign(pixelCount, 0);
+	heatmap.rejects.assign(pixelCount, 0);
+	heatmap.tileNanoseconds.assign(tileCount, 0);
+	heatmap.tileScratch.assign(tileCount, 0);
+	heatmap.maximum = 0;
+	return NT_SUCCESS;
+}
+
+/// <summary>
+/// Replaces the display's frame buffer with a heatmap of one view. Zero stays black, anything above runs from blue
+/// through green and yellow to red at heatmap.maximum, the largest value in the view.
+/// </summary>
+/// <param name="display"></param>
+/// <param name="heatmap"></param>
+/// <param name="view"></param>
+/// <returns></returns>
+int NtWriteHeatmap(NtDisplay* display, NtHeatmap& heatmap, NT_DEBUG_VIEW view) {
+	if (display == nullptr || display->frameBuffer == nullptr || view == NT_VIEW_SHADED) return NT_FAILURE;
+	if (display->xRes != heatmap.xRes || display->yRes != heatmap.yRes) return NT_FAILURE;
+	auto value = [&heatmap, view](int x, int y) -> double {
+		if (view == NT_VIEW_OVERDRAW) return heatmap.fragments[x + y * heatmap.xRes];
+		if (view == NT_VIEW_DEPTH_REJECTS) return heatmap.rejects[x + y * heatmap.xRes];
+		return heatmap.tileNanoseconds[x / NT_HEATMAP_TILE_SIZE + (y / NT_HEATMAP_TILE_SIZE) * heatmap.tileCountX];
+	};
+	heatmap.maximum = 0;
+	for (int y = 0; y < heatmap.yRes; y++) {
+		for (int x = 0; x < heatmap.xRes; x++) {
+			heatmap.maximum = std::max(heatmap.maximum, value(x, y));
+		}
+	}
+
+	static const Vector3 ramp[] = { Vector3(0, 0, 1), Vector3(0, 1, 1), Vector3(0, 1, 0), Vector3(1, 1, 0), Vector3(1, 0, 0) };
+	const int stops = sizeof(ramp) / sizeof(ramp[0]);
+	//Every pixel is written, pending fast clears must not land on top later
+	NtResolveFastClear(display);
+	for (int y = 0; y < heatmap.yRes; y++) {
+		for (int x = 0; x < heatmap.xRes; x++) {
+			double current = value(x, y);
+			Vector3 color(0, 0, 0);
+			if (current > 0) {
+				float t = (float)(current / heatmap.maximum) * (stops - 1);
+				int stop = std::min((int)t, stops - 2);
+				float blend = t - stop;
+				color = ramp[stop] * (1 - blend) + ramp[stop + 1] * blend;
+			}
+			NtPutDisplay(display, x, y, NTMath::fts(color.x), NTMath::fts(color.y), NTMath::fts(color.z), 255);
+		}
+	}
+	return NT_SUCCESS;
+}
+
+/// <summary>
+/// Starts recording trace events on every thread, discarding any previous trace. Recording never locks: each thread
+/// writes its own ring of eventsPerThread events, where the oldest are overwritten once it is full.
+/// Safe to call while frames render: threads keep writing their buffers of the previous trace, which are no longer
+/// exported, until their next event hands them a fresh one.
+/// </summary>
+/// <param name="eventsPerThread"></param>
+/// <returns>NT_FAILURE when built with NT_TRACE 0</returns>
+int NtBeginTrace(size_t eventsPerThread) {
+#if NT_TRACE
+	if (eventsPerThread == 0) return NT_FAILURE;
+	std::lock_guard<std::mutex> lock(ntTraceMutex);
+	ntTraceActive = false;
+	ntTraceCapacity = eventsPerThread;
+	ntTraceStartTicks = std::chrono::steady_clock::now().time_since_epoch().count();
+	ntTraceSession++;
+	ntTraceActive = true;
+	return NT_SUCCESS;
+#else
+	NtLog(std::cerr, "NtBeginTrace: built without NT_TRACE\n");
+	return NT_FAILURE;
+#endif
+}
+
+/// <summary>
+/// Stops recording and writes every thread's events as Chrome trace event JSON, viewable in chrome://tracing or
+/// Perfetto. Call it once no frame is rendering, events of scopes still open are not included.
+/// </summary>
+/// <param name="path"></param>
+/// <returns></returns>
+int NtEndTrace(const std::string& path) {
+#if NT_TRACE
+	std::lock_guard<std::mutex> lock(ntTraceMutex);
+	if (!ntTraceActive) return NT_FAILURE;
+	ntTraceActive = false;
+
+	nlohmann::json events = nlohmann::json::array();
+	unsigned long long dropped = 0;
+	for (const std::unique_ptr<NtTraceBuffer>& buffer : ntTraceBuffers) {
+		if (buffer->session != ntTraceSession.load()) continue;
+		events.push_back({ { "name", "thread_name" }, { "ph", "M" }, { "pid", 1 }, { "tid", buffer->lane },
+			{ "args", { { "name", "NocturneGL " + std::to_string(buffer->lane) } } } });
+		unsigned long long head = buffer->head.load(std::memory_order_acquire);
+		unsigned long long count = std::min<unsigned long long>(head, buffer->events.size());
+		dropped += head - count;
+		for (unsigned long long i = head - count; i < head; i++) {
+			const NtTraceEvent& event = buffer->events[i % buffer->events.size()];
+			nlohmann::json entry = { { "name", event.name }, { "cat", "NocturneGL" }, { "ph", "X" }, { "pid", 1 }, { "tid", buffer->lane },
+				{ "ts", event.start }, { "dur", event.duration } };
+			if (event.detail[0] != 0) entry["args"] = { { "detail", event.detail } };
+			events.push_back(entry);
+		}
+	}
+
+	std::ofstream file(path);
+	if (!file.is_open()) {
+		NtLog(std::cerr, "Failed to write trace " + path + "\n");
 		return NT_FAILURE;
 	}
-	NtFlushDisplayBufferPPM(outfile, displayPtr);
+	nlohmann::json trace = { { "traceEvents", events }, { "displayTimeUnit", "ms" }, { "otherData", { { "droppedEvents", dropped } } } };
+	file << trace.dump() << "\n";
+	return file ? NT_SUCCESS : NT_FAILURE;
+#else
+	return NT_FAILURE;
+#endif
+}
+
+/// <summary>
+/// Finds the keyframe pair around time and the blend factor between them, clamped to the first and last keyframe
+/// </summary>
+template<typename Keyframe>
+static void NtFindKeyframes(const std::vector<Keyframe>& keyframes, float time, const Keyframe*& a, const Keyframe*& b, float& t) {
+	auto next = std::upper_bound(keyframes.begin(), keyframes.end(), time,
+		[](float value, const Keyframe& keyframe) { return value < keyframe.time; });
+	if (next == keyframes.begin()) {
+		a = b = &keyframes.front();
+		t = 0;
+		return;
+	}
+	if (next == keyframes.end()) {
+		a = b = &keyframes.back();
+		t = 0;
+		return;
+	}
+	a = &*(next - 1);
+	b = &*next;
+	t = (time - a->time) / (b->time - a->time);
+}
+
+/// <summary>
+/// Linearly interpolates scale, rotation (degrees, per axis) and translation at time, keyframes must be non empty
+/// </summary>
+/// <param name="keyframes"></param>
+/// <param name="time"></param>
+/// <returns></returns>
+NtTransformation NtInterpolateTransform(const std::vector<NtTransformKeyframe>& keyframes, float time) {
+	const NtTransformKeyframe* a;
+	const NtTransformKeyframe* b;
+	float t;
+	NtFindKeyframes(keyframes, time, a, b, t);
+
+	NtTransformation result;
+	result.scale = a->transforms.scale * (1 - t) + b->transforms.scale * t;
+	result.rotation = a->transforms.rotation * (1 - t) + b->transforms.rotation * t;
+	result.translation = a->transforms.translation * (1 - t) + b->transforms.translation * t;
+	return result;
+}
+
+/// <summary>
+/// Poses the scene at time: every keyframed shape gets its interpolated transforms and a keyframed camera its from/to.
+/// Static shapes and cameras are left untouched.
+/// </summary>
+/// <param name="scene"></param>
+/// <param name="time"></param>
+/// <returns></returns>
+int NtSetSceneTime(NtScene* scene, float time) {
+	if (scene == nullptr) return NT_FAILURE;
+	for (NtShape& shape : scene->shapes) {
+		if (!shape.keyframes.empty()) {
+			shape.transforms = NtInterpolateTransform(shape.keyframes, time);
+		}
+	}
+
+	if (!scene->cameraKeyframes.empty()) {
+		const NtCameraKeyframe* a;
+		const NtCameraKeyframe* b;
+		float t;
+		NtFindKeyframes(scene->cameraKeyframes, time, a, b, t);
+		scene->camera.from = a->from * (1 - t) + b->from * t;
+		scene->camera.to = a->to * (1 - t) + b->to * t;
+	}
 	return NT_SUCCESS;
 }
 
+/// <summary>
+/// Checks that pattern is safe as a printf format for a single int: exactly one %d or %i conversion with optional
+/// flags and width, any other % must be an escaped %%
+/// </summary>
+/// <param name="pattern"></param>
+/// <returns></returns>
+static bool NtIsFramePattern(const std::string& pattern) {
+	int conversions = 0;
+	for (size_t i = 0; i < pattern.size(); i++) {
+		if (pattern[i] != '%') continue;
+		i++;
+		if (i < pattern.size() && pattern[i] == '%') continue;
+		while (i < pattern.size() && strchr("-+ 0#", pattern[i]) != nullptr) i++;
+		while (i < pattern.size() && isdigit(static_cast<unsigned char>(pattern[i]))) i++;
+		if (i >= pattern.size() || (pattern[i] != 'd' && pattern[i] != 'i')) return false;
+		conversions++;
+	}
+	return conversions == 1;
+}
+
+/// <summary>
+/// Renders frameCount frames of an already loaded scene, each worker reuses one render context for all of its frames.
+/// Frame i is posed at startTime + (endTime - startTime) * i / frameCount, so endTime itself is excluded and looping
+/// animations don't repeat their first frame. outputPattern is a printf pattern taking the frame index, eg. "frame_%04d.ppm",
+/// and is rejected unless it holds exactly one integer conversion.
+/// Frames are scheduled through NtRenderJobs on threadCount workers, 0 = one worker per core.
+/// </summary>
+/// <param name="scene"></param>
+/// <param name="outputPattern"></param>
+/// <param name="frameCount"></param>
+/// <param name="startTime"></param>
+/// <param name="endTime"></param>
+/// <param name="shadingMode"></param>
+/// <param name="threadCount"></param>
+/// <param name="frameStats">Optional, receives each frame's render statistics</param>
+/// <returns></returns>
+int NtRenderSequence(NtScene* scene, const std::string& outputPattern, int frameCount, float startTime, float endTime, NT_SHADING_MODE shadingMode, int threadCount,
+	std::vector<NtRenderStats>* frameStats) {
+	if (scene == nullptr || frameCount <= 0) return NT_FAILURE;
+	if (!NtIsFramePattern(outputPattern)) {
+		NtLog(std::cerr, "NtRenderSequence: output pattern " + outputPattern + " must hold exactly one integer conversion such as %04d\n");
+		return NT_FAILURE;
+	}
+	char outputName[512];
+	std::vector<NtRenderJob> jobs(frameCount);
+	if (frameStats != nullptr) frameStats->assign(frameCount, NtRenderStats());
+	for (int frame = 0; frame < frameCount; frame++) {
+		snprintf(outputName, sizeof(outputName), outputPattern.c_str(), frame);
+		jobs[frame].scene = scene;
+		jobs[frame].time = startTime + (endTime - startTime) * frame / frameCount;
+		jobs[frame].outputName = outputName;
+		jobs[frame].shadingMode = shadingMode;
+		if (frameStats != nullptr) jobs[frame].stats = &(*frameStats)[frame];
+	}
+	return NtRenderJobs(jobs, threadCount);
+}
+
+/// <summary>
+/// Renders independent jobs concurrently, each worker owns a render context and pulls the next job when done.
+/// Job scenes are only read: each worker poses a private copy of its scene's shapes and camera, kept across its jobs of
+/// that scene, while the meshes and textures behind the copied maps are shared. Returns NT_FAILURE if any job failed.
+/// </summary>
+/// <param name="jobs"></param>
+/// <param name="threadCount">0 = one worker per hardware core</param>
+/// <returns></returns>
+int NtRenderJobs(const std::vector<NtRenderJob>& jobs, int threadCount) {
+	if (threadCount <= 0) threadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	threadCount = std::min(threadCount, static_cast<int>(jobs.size()));
+	std::atomic<int> nextJob(0);
+	std::atomic<int> status(0);
+
+	auto worker = [&]() {
+		ntSerialThread = threadCount > 1;
+		NtRenderContext* context;
+		NtNewRenderContext(&context);
+		//Posing only rewrites keyframed shapes and the camera, so consecutive jobs of one scene reuse the worker's copy
+		//and its scene graph only rebuilds the nodes that moved since the worker's previous frame
+		NtScene frameScene;
+		const NtScene* frameSource = nullptr;
+		for (int i = nextJob++; i < static_cast<int>(jobs.size()); i = nextJob++) {
+			const NtRenderJob& job = jobs[i];
+			if (job.scene == nullptr) {
+				status |= NT_FAILURE;
+				continue;
+			}
+			NT_TRACE_SCOPE("NtRenderJob", job.outputName.c_str());
+			if (frameSource != job.scene) {
+				frameScene = *job.scene;
+				frameSource = job.scene;
+			}
+			int jobStatus = NtSetSceneTime(&frameScene, job.time);
+			jobStatus |= NtRenderScene(context, &frameScene, job.outputName, job.shadingMode);
+			if (job.stats != nullptr) *job.stats = context->stats;
+			status |= jobStatus;
+		}
+		NtFreeRenderContext(context);
+		ntSerialThread = false;
+	};
+
+	std::vector<std::thread> workers;
+	for (int i = 1; i < threadCount; i++) {
+		workers.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& thread : workers) {
+		thread.join();
+	}
+	return status ? NT_FAILURE : NT_SUCCESS;
+}
+
 /// <summary>
 /// Sets the render attribute based on scene data
 /// </summary>
@@ -1206,24 +4791,47 @@ Vector3 NtLightingPhong(const NtMaterial& material, const Vector3& normal, const
 	return color;
 }
 
-void NtTexturePixel(Vector3& color, const NtMaterial& material, Vector2 vertsUV[], Vector3 triVerts[], float alpha, float beta, float gamma) {
-	//Divide U, V by z
-	Vector3 vertsU = { vertsUV[0].x / triVerts[0].z, vertsUV[1].x / triVerts[1].z, vertsUV[2].x / triVerts[2].z };
-	Vector3 vertsV = { vertsUV[0].y / triVerts[0].z, vertsUV[1].y / triVerts[1].z, vertsUV[2].y / triVerts[2].z };
-
-	float s = NtInterpolate(vertsU, alpha, beta, gamma);
-	float t = NtInterpolate(vertsV, alpha, beta, gamma);
-
-	if (nullptr == material.texture) {
-		std::cerr << "Error Getting Texture, Material has null texture ptr!\n";
-		return;
-	}
-
-	Vector3 vertsZ = { 1 / triVerts[0].z, 1 / triVerts[1].z ,1 / triVerts[2].z };
-	float z = 1 / NtInterpolate(vertsZ, alpha, beta, gamma);
+/// <summary>
+/// Builds the perspective correct texture planes of a screen space triangle, the only divides texturing needs per triangle
+/// </summary>
+/// <param name="setup"></param>
+/// <param name="vertsUV"></param>
+/// <param name="triVerts">Screen space vertices, z is the depth texture coordinates are divided by</param>
+/// <returns>NT_FAILURE for a triangle with no area, whose planes are then constant</returns>
+int NtSetupTexture(NtTextureSetup& setup, const Vector2 vertsUV[], const Vector3 triVerts[]) {
+	float oneOverZ[3] = { 1 / triVerts[0].z, 1 / triVerts[1].z, 1 / triVerts[2].z };
+	float uOverZ[3] = { vertsUV[0].x * oneOverZ[0], vertsUV[1].x * oneOverZ[1], vertsUV[2].x * oneOverZ[2] };
+	float vOverZ[3] = { vertsUV[0].y * oneOverZ[0], vertsUV[1].y * oneOverZ[1], vertsUV[2].y * oneOverZ[2] };
+
+	setup.originX = triVerts[0].x;
+	setup.originY = triVerts[0].y;
+	float x1 = triVerts[1].x - triVerts[0].x;
+	float y1 = triVerts[1].y - triVerts[0].y;
+	float x2 = triVerts[2].x - triVerts[0].x;
+	float y2 = triVerts[2].y - triVerts[0].y;
+	float area = x1 * y2 - x2 * y1;
+
+	auto plane = [&](const float value[3]) {
+		if (area == 0) return Vector3(value[0], 0, 0);
+		float d1 = value[1] - value[0];
+		float d2 = value[2] - value[0];
+		return Vector3(value[0], (d1 * y2 - d2 * y1) / area, (d2 * x1 - d1 * x2) / area);
+	};
+	setup.uOverZ = plane(uOverZ);
+	setup.vOverZ = plane(vOverZ);
+	setup.oneOverZ = plane(oneOverZ);
+	return area == 0 ? NT_FAILURE : NT_SUCCESS;
+}
 
-	s *= z;
-	t *= z;
+/// <summary>
+/// Blends the texture sample at pixel (x, y) into color, material must have a texture
+/// </summary>
+void NtTexturePixel(Vector3& color, const NtMaterial& material, const NtTextureSetup& setup, float x, float y) {
+	float dx = x - setup.originX;
+	float dy = y - setup.originY;
+	float z = 1 / (setup.oneOverZ.x + setup.oneOverZ.y * dx + setup.oneOverZ.z * dy);
+	float s = (setup.uOverZ.x + setup.uOverZ.y * dx + setup.uOverZ.z * dy) * z;
+	float t = (setup.vOverZ.x + setup.vOverZ.y * dx + setup.vOverZ.z * dy) * z;
 
 	//Blend pixel texture map color with the original color, here alpha from pixel is disposed
 	//To make sure the final color is still in [0, 1] we clip all components of it
@@ -2,6 +2,10 @@
 #include<iostream>
 #include<vector>
 #include <unordered_map>
+#include <functional>
+#include <future>
+#include <memory>
+#include <cmath>
 /*Pixel Data*/
 typedef struct {
 	unsigned short r, g, b, a;
@@ -57,29 +61,96 @@ static NtPixelf NtPixelAddition(const NtPixelf& a, const NtPixelf& b) {
 }
 
 
+//Texel order in memory. Tiled and Morton keep a bilinear footprint, and the footprints of neighbouring pixels
+//along any UV gradient, within a few cache lines where linear rows would be a texture width apart.
+typedef enum NT_TEXTURE_LAYOUT {
+	NT_TEXTURE_LINEAR,
+	NT_TEXTURE_TILED, /* Square power of two tiles, row major inside and between tiles */
+	NT_TEXTURE_MORTON /* Z-order inside the largest power of two squares that fit the level, squares row major */
+} NT_TEXTURE_LAYOUT;
+#define NT_TEXTURE_TILE_SIZE 8 //Default tile size, any power of two from 2 to 64 is accepted
+#define NT_TEXTURE_MAX_MIPS 16
+#define NT_TEXTURE_MAX_SIZE 65535
+
+//RGBA8 texture, either decoded from a PPM into memory or sampled straight from a memory mapped .ntx container
 class NtTexture {
 private:
 	int width;
 	int height;
-	std::vector<std::vector<NtPixelf>> textureData;
+	NT_TEXTURE_LAYOUT layout = NT_TEXTURE_LINEAR;
+	int tileSize = NT_TEXTURE_TILE_SIZE;
+	int mipCount = 0;
+	int levelWidth[NT_TEXTURE_MAX_MIPS];
+	int levelHeight[NT_TEXTURE_MAX_MIPS];
+	int levelPitch[NT_TEXTURE_MAX_MIPS]; //Texels per row when linear, blocks per row otherwise
+	int levelShift[NT_TEXTURE_MAX_MIPS]; //Log2 of the block side, a tile or a Morton square
+	size_t levelOffset[NT_TEXTURE_MAX_MIPS]; //Byte offset of each level from Base()
+	std::vector<unsigned char> texels; //Decoded images only
+	std::shared_ptr<void> mapping; //Keeps a mapped container alive, shared between copies
+	const unsigned char* mappedTexels = nullptr;
+	bool LoadPPM(const std::string& filename, const char* begin, const char* end, NT_TEXTURE_LAYOUT targetLayout, int targetTileSize);
+	bool LoadContainer(const std::string& filename, const char* begin, const char* end, const std::shared_ptr<void>& owner);
+	void Load(const std::string& filename, const char* begin, const char* end, const std::shared_ptr<void>& owner, NT_TEXTURE_LAYOUT layout, int tileSize);
+	bool SetLayout(NT_TEXTURE_LAYOUT newLayout, int newTileSize);
+	const unsigned char* Base() const { return mapping ? mappedTexels : texels.data(); }
+
+	//Spreads the low 16 bits of v to the even bit positions
+	static unsigned int SpreadBits(unsigned int v) {
+		v &= 0xFFFF;
+		v = (v | (v << 8)) & 0x00FF00FF;
+		v = (v | (v << 4)) & 0x0F0F0F0F;
+		v = (v | (v << 2)) & 0x33333333;
+		v = (v | (v << 1)) & 0x55555555;
+		return v;
+	}
+
+	static size_t TexelIndex(int x, int y, int pitch, int shift, NT_TEXTURE_LAYOUT layout) {
+		if (layout == NT_TEXTURE_LINEAR) {
+			return (size_t)y * pitch + x;
+		}
+		unsigned int mask = (1u << shift) - 1;
+		size_t block = ((size_t)(y >> shift) * pitch + (x >> shift)) << (2 * shift);
+		if (layout == NT_TEXTURE_MORTON) {
+			return block | SpreadBits(x & mask) | (SpreadBits(y & mask) << 1);
+		}
+		return block + ((y & mask) << shift) + (x & mask);
+	}
+
+	static void LevelAddressing(int width, int height, NT_TEXTURE_LAYOUT layout, int tileSize, int& pitch, int& shift);
+	static size_t LevelBytes(int width, int height, NT_TEXTURE_LAYOUT layout, int tileSize);
+	static bool ValidTileSize(int tileSize) { return tileSize >= 2 && tileSize <= 64 && (tileSize & (tileSize - 1)) == 0; }
 public:
 	int GetWidth() const { return width; }
 	int GetHeight() const { return height; }
-	NtTexture(const std::string& filename);
-
-	NtPixelf GetPixelf(int x, int y) const {
-		if (x >= 0 && x < width && y >= 0 && y < height) {
-			NtPixelf result;
-			result.r = textureData[y][x].r;
-			result.g = textureData[y][x].g;
-			result.b = textureData[y][x].b;
-			result.a = textureData[y][x].a;
-			return result;
+	int GetMipCount() const { return mipCount; }
+	NT_TEXTURE_LAYOUT GetLayout() const { return layout; }
+	int GetTileSize() const { return tileSize; }
+	size_t GetResidentBytes() const { return sizeof(NtTexture) + texels.capacity(); } //Heap only, mapped pages belong to the page cache
+
+	//Decoded PPMs are stored in the requested layout, containers keep the layout they were written with
+	NtTexture(const std::string& filename, NT_TEXTURE_LAYOUT layout = NT_TEXTURE_LINEAR, int tileSize = NT_TEXTURE_TILE_SIZE);
+	//Same from file bytes already in memory, filename picks the format. A container samples the bytes in place while
+	//owner keeps them alive, without an owner it copies them.
+	NtTexture(const std::string& filename, const char* begin, const char* end, const std::shared_ptr<void>& owner,
+		NT_TEXTURE_LAYOUT layout = NT_TEXTURE_LINEAR, int tileSize = NT_TEXTURE_TILE_SIZE);
+
+	//Returns the 4 byte RGBA texel at (x, y) of a mip level, coordinates must be in range
+	const unsigned char* GetTexel(int x, int y, int level = 0) const {
+		return Base() + levelOffset[level] + TexelIndex(x, y, levelPitch[level], levelShift[level], layout) * 4;
+	}
+
+	NtPixelf GetPixelf(int x, int y, int level = 0) const {
+		if (level >= 0 && level < mipCount && x >= 0 && x < levelWidth[level] && y >= 0 && y < levelHeight[level]) {
+			const unsigned char* texel = GetTexel(x, y, level);
+			return { texel[0] / 255.0f, texel[1] / 255.0f, texel[2] / 255.0f, texel[3] / 255.0f };
 		}
 		std::cerr << "NtTexture: Invalid pixel lookup parameters! x: " << x << " y: " << y << " width: " << width << " height: " << height << "\n";
 		return { 0, 0, 0 ,0 };
 	}
+
+	friend int NtWriteTextureContainer(const NtTexture& texture, const std::string& path, NT_TEXTURE_LAYOUT layout, int tileSize);
 };
+int NtWriteTextureContainer(const NtTexture& texture, const std::string& path, NT_TEXTURE_LAYOUT layout = NT_TEXTURE_TILED, int tileSize = NT_TEXTURE_TILE_SIZE);
 NtPixelf NtTextureLookUp(float u, float v, const NtTexture& texture, bool horizontalFlip = true);
 
 /*Constants*/
@@ -293,7 +364,50 @@ typedef struct {
 	float shiftX, shiftY, weight;
 } NtAAShift;
 
+/*Anti-aliasing*/
+#define NT_AA_MAX_SAMPLES 16 /* largest non legacy pattern, sample counts are powers of two up to it */
+#define NT_AA_GAUSSIAN_SIGMA 0.35f
+
+enum NT_AA_PATTERN {
+	NT_AA_PATTERN_LEGACY,			//Original hand tuned 6 tap table with its own weights, requires 6 samples
+	NT_AA_PATTERN_ROTATED_GRID,		//Standard rotated/sparse grid positions, 1, 2, 4, 8 or 16 samples
+	NT_AA_PATTERN_POISSON			//Seeded Poisson disk positions, 1, 2, 4, 8 or 16 samples
+};
+
+enum NT_AA_FILTER {
+	NT_AA_FILTER_BOX,
+	NT_AA_FILTER_TENT,
+	NT_AA_FILTER_GAUSSIAN
+};
+
+enum NT_AA_MODE {
+	NT_AA_SUPERSAMPLE,	//Render the whole scene once per sample
+	NT_AA_ADAPTIVE,		//Render once at pixel centers, then supersample only detected edge pixels
+	NT_AA_FXAA			//Render once at pixel centers, then run FXAA on the frame buffer. Sample settings are ignored
+};
+
+typedef struct NtAASettings {
+	int sampleCount = 6; //0 disables anti-aliasing
+	NT_AA_PATTERN pattern = NT_AA_PATTERN_LEGACY;
+	NT_AA_FILTER filter = NT_AA_FILTER_BOX;
+	NT_AA_MODE mode = NT_AA_SUPERSAMPLE;
+	float edgeDepthThreshold = 0.01f; //Adaptive: NDC depth jump between neighbors treated as an edge
+	float edgeColorThreshold = 0.1f; //Adaptive: max channel difference in [0, 1] treated as an edge
+	float fxaaEdgeThreshold = 0.125f; //FXAA: local luma contrast, relative to the brightest neighbor, needed to process a pixel
+	float fxaaEdgeThresholdMin = 0.0312f; //FXAA: absolute luma contrast below which dark pixels are skipped
+	float fxaaSubpixelQuality = 0.75f; //FXAA: amount of sub-pixel aliasing removal, 0 = off, 1 = softest
+} NtAASettings;
+
+//Adaptive anti-aliasing pixel mask, shared by all sample renders of a display
+typedef struct NtAAEdgeMask {
+	std::vector<unsigned char> mask; //1 = edge pixel, row-major xRes * yRes
+	std::vector<int> rowMin, rowMax; //Inclusive x span of edge pixels per row, rowMin > rowMax when the row has none
+	int edgeCount = 0;
+} NtAAEdgeMask;
+
 /*Rendering*/
+#define NT_CLEAR_TILE_SIZE 16 /* fast clear tile edge in pixels */
+
 typedef struct {
 	unsigned short	xRes;
 	unsigned short	yRes;
@@ -301,7 +415,13 @@ typedef struct {
 	NtPixel* frameBuffer;		/* frame buffer array */
 	int sampleCount;
 	std::vector<NtPixel*> sampleBuffer; /*anti aliasing, sample final with weighted average*/
-	NtAAShift aaShifts[6];
+	std::vector<NtAAShift> aaShifts; /*one sub-pixel offset and normalized weight per sample*/
+
+	/*fast clear, tiles are written with clearPixel on first touch instead of at clear time*/
+	NtPixel clearPixel;
+	int tileCountX, tileCountY;
+	std::vector<unsigned char> tilePending; /*[buffer * tiles + tile], buffer 0 = frame buffer, 1 + i = sample buffer i*/
+	int pendingTileCount;
 } NtDisplay;
 
 typedef struct NtVertex {
@@ -332,6 +452,78 @@ typedef struct NtCamera
 	int xRes;
 	int yRes;
 } NzCamera;
+/*Statistics*/
+#ifndef NT_RENDER_STATS
+#define NT_RENDER_STATS 1 /* 0 compiles every counter and stage timer out of the render path */
+#endif
+#define NT_STATS_TIMING_INTERVAL 32 /* every Nth triangle of a render is timed, per triangle stage totals are scaled from the sample */
+
+enum NT_RENDER_STAGE {
+	NT_STAGE_LOAD,		//Scene parse and asset loads, carried over from the scene
+	NT_STAGE_TRANSFORM,	//Vertex transform, projection and culling
+	NT_STAGE_RASTER,	//Coverage and depth test
+	NT_STAGE_SHADE,		//Lighting and texturing, per triangle setup included
+	NT_STAGE_RESOLVE,	//Anti-aliasing edge detection, sample resolve and FXAA
+	NT_STAGE_FLUSH,		//Output encode and write
+	NT_STAGE_COUNT
+};
+
+//Counters of one frame, summed over the main render and every sample render
+typedef struct NtRenderStats {
+	int frame = 0; //Frames rendered with the context before this one
+	int xRes = 0;
+	int yRes = 0;
+	int renderCount = 0; //Main render plus sample renders drawn into
+	unsigned long long trianglesSubmitted = 0;
+	unsigned long long trianglesCulled = 0; //Zero area after projection and clipping, which includes entirely off screen
+	unsigned long long trianglesRasterized = 0;
+	unsigned long long pixelsTested = 0; //Covered pixels that reached the depth test
+	unsigned long long depthPasses = 0;
+	unsigned long long fragmentsShaded = 0;
+	unsigned long long textureFetches = 0; //Bilinear lookups
+	unsigned long long samplesCovered = 0; //Pixels of all renders written at least once
+	unsigned long long timedTriangles = 0;
+	int nodesUpdated = 0; //Scene graph nodes whose world matrices were rebuilt this frame
+	double stageSeconds[NT_STAGE_COUNT] = {};
+	double frameSeconds = 0; //NtRenderScene wall time, load excluded
+} NtRenderStats;
+float NtOverdrawRatio(const NtRenderStats& stats);
+std::string NtRenderStatsJSON(const NtRenderStats& stats);
+int NtWriteRenderStatsJSON(const std::string& path, const NtRenderStats& stats);
+
+/*Diagnostic views*/
+#define NT_HEATMAP_TILE_SIZE 16 /* tile edge in pixels of the tile cost view */
+
+enum NT_DEBUG_VIEW {
+	NT_VIEW_SHADED,			//Normal rendering
+	NT_VIEW_OVERDRAW,		//Fragments that passed the depth test per pixel
+	NT_VIEW_DEPTH_REJECTS,	//Fragments that failed the depth test per pixel
+	NT_VIEW_TILE_COST		//Nanoseconds per NT_HEATMAP_TILE_SIZE tile, each triangle's time split by the pixels it tested there
+};
+
+//Counters gathered while a heatmap view renders, at one sample per pixel
+typedef struct NtHeatmap {
+	int xRes = 0;
+	int yRes = 0;
+	int tileCountX = 0;
+	int tileCountY = 0;
+	std::vector<unsigned int> fragments; //Row-major
+	std::vector<unsigned int> rejects; //Row-major
+	std::vector<double> tileNanoseconds; //Row-major tiles
+	std::vector<unsigned int> tileScratch; //Pixels tested per tile by the triangle being drawn, zero between triangles
+	double maximum = 0; //Value at the top of the color ramp in the last written view
+} NtHeatmap;
+int NtResetHeatmap(NtHeatmap& heatmap, int xRes, int yRes);
+int NtWriteHeatmap(NtDisplay* display, NtHeatmap& heatmap, NT_DEBUG_VIEW view);
+
+/*Tracing*/
+#ifndef NT_TRACE
+#define NT_TRACE 1 /* 0 compiles every trace scope out, NtBeginTrace then records nothing */
+#endif
+#define NT_TRACE_DEFAULT_CAPACITY 16384 /* events kept per thread, the oldest are overwritten once full */
+int NtBeginTrace(size_t eventsPerThread = NT_TRACE_DEFAULT_CAPACITY);
+int NtEndTrace(const std::string& path);
+
 /*Renderer*/
 typedef struct {
 	NtDisplay* display;
@@ -345,6 +537,12 @@ typedef struct {
 	NtLight directionalLight;
 	NtLight ambientLight;
 	int sampleRenderNum; //-1 = main render, >= 0 -> this render a sample render
+	int* idBuffer; //Optional row-major primitive id of the closest triangle per pixel, -1 = background
+	int primitiveCount; //Triangles put so far, used as primitive id
+	const NtAAEdgeMask* edgeMask; //Adaptive anti-aliasing, when set only masked pixels are rasterized
+	bool depthTest = true; //Off draws every covered pixel in submission order
+	NtRenderStats* stats = nullptr; //Counters of the owning context's frame, null = not counted
+	NtHeatmap* heatmap = nullptr; //Set only while a diagnostic view renders
 }  NtRender;
 
 
@@ -383,6 +581,18 @@ typedef struct NtTransformation {
 	Vector3 rotation;
 	Vector3 translation;
 }NtTransformation;
+
+//Animation, keyframes are sorted by time and linearly interpolated, clamped outside the keyed range
+typedef struct NtTransformKeyframe {
+	float time;
+	NtTransformation transforms;
+} NtTransformKeyframe;
+
+typedef struct NtCameraKeyframe {
+	float time;
+	Vector3 from;
+	Vector3 to;
+} NtCameraKeyframe;
 typedef struct NtMaterial {
 	Vector3 surfaceColor;
 	float Ka;
@@ -391,47 +601,95 @@ typedef struct NtMaterial {
 	float Kt = 0.7f;
 	float specularExponent;
 	std::string textureId;
-	NtTexture* texture;
+	NtTexture* texture = nullptr;
 } NtMaterial;
+//Instancing, one mesh drawn many times by a single shape. Instance transforms apply before the shape's own.
+typedef struct NtInstance {
+	NtTransformation transforms;
+	NtMaterial material; //The shape's material with the instance's overrides
+} NtInstance;
 typedef struct NtShape
 {
 	std::string id;
 	std::string geometryId;
 	std::string notes;
 	NtMaterial material;
-	NtTransformation transforms;
+	NtTransformation transforms; //Relative to the parent shape, or to the world for roots
+	std::vector<NtTransformKeyframe> keyframes; //Optional, overrides transforms per frame when animated
+	int parent = -1; //Index of an earlier shape in NtScene::shapes this one is attached to, -1 = root
+	std::vector<NtInstance> instances; //Optional, the mesh is drawn once per instance instead of once
 
 } NtShape;
 
+//Scene graph, cached world matrices of one shape. A node is rebuilt when its transforms or parent differ from the ones
+//it was built from, or when its parent was rebuilt in the same update, so sparse animation only touches moved subtrees.
+typedef struct NtSceneNode {
+	NtTransformation transforms; //Local transforms the matrices were built from
+	int parent = -1;
+	NtMatrix world;
+	NtMatrix worldInverse; //Normal matrix, handed to NtSetWorldMatrix as is
+	bool dirty = true; //Rebuild on the next update regardless of transforms, new nodes start dirty
+	bool changed = false; //Rebuilt by the latest update, children rebuild along with it
+} NtSceneNode;
+
 typedef struct  NtScene
 {
 	std::vector<NtShape> shapes;
+	std::vector<NtSceneNode> nodes; //One per shape, maintained by NtUpdateSceneGraph
 	NtCamera camera;
 	std::unordered_map<std::string, NtMesh*> meshMap;
 	std::unordered_map<std::string, NtTexture*> textureMap;
 	std::vector<NtLight> lights;
 	NtLight directional;
 	NtLight ambient;
+	NtAASettings aaSettings;
+	std::vector<NtCameraKeyframe> cameraKeyframes; //Optional, overrides camera from/to per frame when animated
+	double loadSeconds = 0; //Wall time spent in NtLoadSceneJSON and NtLoadSceneAssets
 } NtScene;
 
+//Persistent buffers for rendering many frames, reallocated only when resolution or sample count changes
+typedef struct NtRenderContext {
+	NtDisplay* display = nullptr;
+	NtRender* render = nullptr; //Main render, writes the frame buffer directly
+	std::vector<NtRender*> sampleRenders; //One per anti-aliasing sample
+	NtAAEdgeMask edgeMask; //Adaptive anti-aliasing scratch, reused across frames
+	NtCamera camera; //Per frame copy of the scene camera with its derived matrices, the scene itself is never written
+	Vector4 backgroundColor = { 0, 0, 0, 255 };
+	bool fastClear = false; //Defer color buffer clears to first touch per tile, untouched tiles are never written
+	NtRenderStats stats; //Last frame, zero when NT_RENDER_STATS is 0
+	NT_DEBUG_VIEW debugView = NT_VIEW_SHADED; //Heatmap views render one sample per pixel and flush the heatmap instead of the image
+	NtHeatmap heatmap;
+	bool writeStats = false; //Write stats beside each flushed frame, output.ppm -> output.stats.json
+	int frameCount = 0;
+} NtRenderContext;
+
 /*Core Functions*/
 int NtSetShadingMode(NtRender* render, NT_SHADING_MODE mode);
+int NtSetDepthTest(NtRender* render, bool depthTest);
 int NtNewFrameBuffer(NtPixel** frameBuffer, int width, int height);
-int NtNewDisplay(NtDisplay** display, int xRes, int yRes, Vector4 backgroundColor = { 0, 0, 0, 255 }, int aaSampleCount = 6);
-int NtLoadAAFilter(NtDisplay* display);
+int NtNewDisplay(NtDisplay** display, int xRes, int yRes, Vector4 backgroundColor = { 0, 0, 0, 255 }, int aaSampleCount = 6, NT_AA_PATTERN aaPattern = NT_AA_PATTERN_LEGACY, NT_AA_FILTER aaFilter = NT_AA_FILTER_BOX);
+int NtLoadAAFilter(NtDisplay* display, NT_AA_PATTERN pattern = NT_AA_PATTERN_LEGACY, NT_AA_FILTER filter = NT_AA_FILTER_BOX);
+float NtAAFilterWeight(NT_AA_FILTER filter, float shiftX, float shiftY);
 int NtFreeDisplay(NtDisplay* display);
 int NtInitDisplay(NtDisplay* display, const Vector4& backgroundColor, int aaSampleCount); //Default black
+int NtClearDisplay(NtDisplay* display, const Vector4& backgroundColor, bool fastClear = false);
+int NtResolveFastClear(NtDisplay* display);
 int NtFlushDisplayBufferPPM(FILE* outfile, NtDisplay* display);
 int NtFlushDisplayBufferJPEG(FILE* outfile, NtDisplay* display);
 int NtPutDisplay(NtDisplay* display, int i, int j, short r, short g, short b, short a, int aaFilterIndex = -1);
-int NtAverageSampleToFrameBuffer(NtDisplay* display);
+int NtAverageSampleToFrameBuffer(NtDisplay* display, const NtAAEdgeMask* edgeMask = nullptr);
+int NtDetectAAEdges(const NtRender* render, float depthThreshold, float colorThreshold, NtAAEdgeMask& edgeMask);
+int NtApplyFXAA(NtDisplay* display, float edgeThreshold = 0.125f, float edgeThresholdMin = 0.0312f, float subpixelQuality = 0.75f);
 int ClipInt(int input, int min, int max);
 float Clipf(float input, int min, int max);
 void ClipVec3(Vector3& vec);
 int NtNewRender(NtRender** render, NtDisplay* display, int sampleRenderNum = -1);
 int NtFreeRender(NtRender* render);
+int NtNewIdBuffer(NtRender* render);
+int NtClearRender(NtRender* render);
 int NtPutTriangle(NtRender* render, Vector3 vertexList[], Vector3 normalList[], Vector2 uvList[], const NtMaterial& material);
 int NtPutTriangle(NtRender* render, NtTriangle& triangle, const NtMaterial& material);
+int NtPutTransformedTriangle(NtRender* render, const Vector4 clipList[], Vector3 normalList[], Vector2 uvList[], const NtMaterial& material);
 
 //////Perspective, Matrix//////
 void NtLoadIdentityMatrix(NtMatrix& mat);
@@ -455,15 +713,107 @@ int NtCalculateProjectionMatrix(NtCamera& camera, float near, float far, float t
 int NtPutCamera(NtRender* render, NtCamera& camera);
 
 int NtLoadSceneJSON(std::string scenePath, NtScene* scene, bool autoLoadMeshAndTexture = true);
+int NtLoadSceneAssets(NtScene* scene);
+std::future<int> NtLoadSceneAssetsAsync(NtScene* scene);
 int NtLoadTexture(NtMaterial& material, NtScene* scene);
 int NtLoadMesh(std::string meshName, const std::string meshExtension, NtScene* scene);
+int NtReadMeshFile(const std::string& path, NtMesh** mesh);
+int NtReadMeshFile(const std::string& path, const char* begin, const char* end, NtMesh** mesh);
+std::string NtResolveMeshPath(const std::string& geometryId);
+int NtParseAASettingsJSON(const std::string& jsonText, NtAASettings& aaSettings);
 int NtSetWorldMatrix(NtRender* render, NtMatrix& matrix, NtMatrix& matrixInverseTransposed);
+int NtUpdateSceneGraph(NtScene* scene, int* updatedCount = nullptr);
 int NtSetRenderAttributes(NtRender* render, NtScene* scene);
 int NtRenderScene(NtScene* scene, const std::string outputName, NT_SHADING_MODE shadingMode = NT_SHADE_FLAT);
+int NtRenderScene(NtRenderContext* context, NtScene* scene, const std::string outputName, NT_SHADING_MODE shadingMode = NT_SHADE_FLAT);
+int NtNewRenderContext(NtRenderContext** context);
+int NtPrepareRenderContext(NtRenderContext* context, int xRes, int yRes, const NtAASettings& aaSettings);
+int NtFreeRenderContext(NtRenderContext* context);
+
+//Animation
+NtTransformation NtInterpolateTransform(const std::vector<NtTransformKeyframe>& keyframes, float time);
+int NtSetSceneTime(NtScene* scene, float time);
+int NtRenderSequence(NtScene* scene, const std::string& outputPattern, int frameCount, float startTime, float endTime, NT_SHADING_MODE shadingMode = NT_SHADE_FLAT, int threadCount = 1,
+	std::vector<NtRenderStats>* frameStats = nullptr);
+
+//Batch rendering, one frame per worker thread
+typedef struct NtRenderJob {
+	const NtScene* scene = nullptr; //Shared read only between jobs, meshes and textures must already be loaded
+	float time = 0; //Scene time the job is posed at, only matters for animated scenes
+	std::string outputName;
+	NT_SHADING_MODE shadingMode = NT_SHADE_FLAT;
+	NtRenderStats* stats = nullptr; //Optional, receives the frame's render statistics
+} NtRenderJob;
+int NtRenderJobs(const std::vector<NtRenderJob>& jobs, int threadCount = 0);
+
+//Asset cache, meshes and textures are shared by every scene and keyed by file content
+#define NT_ASSET_CACHE_DEFAULT_BUDGET (512ull << 20) /* bytes kept resident, only unreferenced assets are evicted */
+typedef struct NtAssetCacheStats {
+	size_t residentBytes = 0;
+	size_t budgetBytes = 0;
+	int meshCount = 0;
+	int textureCount = 0;
+	int idleCount = 0; //Resident with no references, evicted least recently used first
+	int hits = 0; //Acquires served without parsing
+	int misses = 0;
+	int evictions = 0;
+} NtAssetCacheStats;
+int NtAcquireMesh(const std::string& path, NtMesh** mesh);
+int NtAcquireTexture(const std::string& path, NtTexture** texture);
+int NtReleaseMesh(const NtMesh* mesh);
+int NtReleaseTexture(const NtTexture* texture);
+void NtSetAssetCacheBudget(size_t budgetBytes);
+int NtSetTextureLayout(NT_TEXTURE_LAYOUT layout, int tileSize = NT_TEXTURE_TILE_SIZE);
+void NtTrimAssetCache();
+NtAssetCacheStats NtGetAssetCacheStats();
+int NtFreeScene(NtScene* scene);
+
+//Image comparison, for checking renders against golden images
+typedef struct NtImage {
+	int width = 0;
+	int height = 0;
+	int maxValue = 255; //Channel value at full intensity, flushed frames use 5333
+	std::vector<NtPixel> pixels; //Row-major, alpha unused
+} NtImage;
+
+typedef struct NtImageDifference {
+	double maxAbsError = 0; //Largest channel difference as a fraction of full intensity
+	double psnr = INFINITY; //dB over all RGB channels, infinite when identical
+	double ssim = 1; //Mean luma SSIM over 8x8 windows at a stride of 4
+	int differingPixels = 0;
+} NtImageDifference;
+
+typedef struct NtImageTolerance {
+	double maxAbsError = 4.0 / 255;
+	double minPSNR = 40;
+	double minSSIM = 0.995;
+} NtImageTolerance;
+
+int NtReadImagePPM(const std::string& path, NtImage& image);
+int NtWriteImagePPM(const std::string& path, const NtImage& image);
+int NtCompareImages(const NtImage& reference, const NtImage& candidate, NtImageDifference& difference, NtImage* diffImage = nullptr);
+bool NtImageWithinTolerance(const NtImageDifference& difference, const NtImageTolerance& tolerance);
+
+//Utility
+void NtLog(std::ostream& stream, const std::string& message);
+void NtParallelFor(int begin, int end, const std::function<void(int, int)>& body, int minChunk = 1);
+void NtFill64(void* destination, unsigned long long value, size_t count);
+void NtFill32(void* destination, unsigned int value, size_t count);
 
 //Shading
 Vector3 NtLightingPhong(const NtMaterial& material, const Vector3& normal, const NtLight& lightSource, const Vector3& viewDirection, const NtLight& ambientLight);
 Vector3 NtAverageQuadNormals(const Vector3 normalList[]);
 float NtInterpolate(const Vector3& vec, float alpha, float beta, float gamma);
 Vector3 NtInterpolateVector3(const Vector3 vectors[], float alpha, float beta, float gamma, bool isNormal);
-void NtTexturePixel(Vector3& color, const NtMaterial& material, Vector2 vertsUV[], Vector3 triVerts[], float alpha, float beta, float gamma);
\ No newline at end of file
+
+//Per triangle texture setup, screen space plane equations of u/z, v/z and 1/z relative to the first vertex.
+//Each plane holds (value at the origin, change per pixel in x, change per pixel in y).
+typedef struct NtTextureSetup {
+	float originX = 0;
+	float originY = 0;
+	Vector3 uOverZ;
+	Vector3 vOverZ;
+	Vector3 oneOverZ;
+} NtTextureSetup;
+int NtSetupTexture(NtTextureSetup& setup, const Vector2 vertsUV[], const Vector3 triVerts[]);
+void NtTexturePixel(Vector3& color, const NtMaterial& material, const NtTextureSetup& setup, float x, float y);
\ No newline at end of file
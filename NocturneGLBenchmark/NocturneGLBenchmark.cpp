@@ -0,0 +1,720 @@
+#include "../NocturneGL/NocturneGL.h"
+#include "../NocturneGL/externalPlugins/json.hpp"
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cstdlib>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+/*
+ * Benchmark suite. Micro benchmarks time one library stage on generated inputs, macro benchmarks render a scene
+ * (scene5.json, the textured teapot, by default) at 512x512, 1920x1080 and 3840x2160 in every shading mode with and
+ * without anti-aliasing. Each benchmark runs one warm up iteration, then reports median, p95, mean and minimum time,
+ * throughput and heap allocations per iteration. Results are printed and written as JSON for regression tracking:
+ *
+ *   NocturneGLBenchmark [--output benchmark.json] [--filter text] [--iterations n] [--scene scene5.json] [--quick] [--fast-clear]
+ *
+ * --filter runs only benchmarks whose name contains text, --quick drops 4K and uses three iterations.
+ * --fast-clear renders the macro benchmarks with lazy per tile clears, their names get a _fastclear suffix.
+ * Scene, mesh and texture paths resolve against the working directory, as they do for the demo applications.
+ *
+ * --generate writes a reproducible stress scene instead of benchmarking, see NtGenerateStressScene:
+ *
+ *   NocturneGLBenchmark --generate grid|dense|large|overdraw|textured [--directory dir] [--seed n] [--count n]
+ *                       [--resolution WxH] [--detail n] [--texture-size n] [--mesh geometryId] [--instanced]
+ */
+
+using json = nlohmann::json;
+
+//Heap allocations made through operator new, counted for the whole process so library allocations are included
+static std::atomic<unsigned long long> ntAllocationCount{ 0 };
+static std::atomic<unsigned long long> ntAllocationBytes{ 0 };
+
+void* operator new(size_t size) {
+	ntAllocationCount.fetch_add(1, std::memory_order_relaxed);
+	ntAllocationBytes.fetch_add(size, std::memory_order_relaxed);
+	void* memory = std::malloc(size ? size : 1);
+	if (memory == nullptr) throw std::bad_alloc();
+	return memory;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	try { return operator new(size); }
+	catch (...) { return nullptr; }
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return operator new(size, std::nothrow); }
+//The default sized deletes forward to these unsized ones. Aligned new and delete stay the library pair, uncounted
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+
+typedef struct NtBenchmarkOptions {
+	std::string outputPath = "benchmark.json";
+	std::string filter;
+	std::string scenePath = "scene5.json";
+	int iterations = 0; //0 = per benchmark default
+	bool quick = false;
+	bool fastClear = false; //Macro renders defer clears per tile, NtRenderContext::fastClear
+} NtBenchmarkOptions;
+
+typedef struct NtBenchmarkResult {
+	std::string name;
+	std::string kind; //"micro" or "macro"
+	std::string unit; //What one item is, throughput is items per second
+	double items = 0; //Per iteration
+	int iterations = 0;
+	double medianMs = 0;
+	double p95Ms = 0;
+	double meanMs = 0;
+	double minMs = 0;
+	double throughput = 0;
+	double allocations = 0; //Per iteration
+	double allocatedBytes = 0; //Per iteration
+} NtBenchmarkResult;
+
+typedef struct NtBenchmarkSuite {
+	NtBenchmarkOptions options;
+	std::vector<NtBenchmarkResult> results;
+	std::filesystem::path scratch; //Generated inputs and encoder output
+} NtBenchmarkSuite;
+
+/// <summary>
+/// Times body over the configured iterations after one warm up run, body returns NT_FAILURE to abort the benchmark
+/// </summary>
+/// <param name="suite"></param>
+/// <param name="name"></param>
+/// <param name="kind"></param>
+/// <param name="items">Work items per iteration</param>
+/// <param name="unit"></param>
+/// <param name="iterations">Default iteration count</param>
+/// <param name="body"></param>
+template <typename Body>
+static void NtRunBenchmark(NtBenchmarkSuite& suite, const std::string& name, const std::string& kind, double items, const std::string& unit, int iterations, Body body) {
+	if (!suite.options.filter.empty() && name.find(suite.options.filter) == std::string::npos) return;
+	if (suite.options.iterations > 0) iterations = suite.options.iterations;
+	else if (suite.options.quick) iterations = std::min(iterations, 3);
+
+	if (body() != NT_SUCCESS) {
+		NtLog(std::cerr, "Benchmark " + name + " failed\n");
+		return;
+	}
+
+	std::vector<double> times;
+	times.reserve(iterations);
+	unsigned long long allocations = ntAllocationCount.load();
+	unsigned long long bytes = ntAllocationBytes.load();
+	for (int i = 0; i < iterations; i++) {
+		auto start = std::chrono::steady_clock::now();
+		int status = body();
+		auto stop = std::chrono::steady_clock::now();
+		if (status != NT_SUCCESS) {
+			NtLog(std::cerr, "Benchmark " + name + " failed\n");
+			return;
+		}
+		times.push_back(std::chrono::duration<double, std::milli>(stop - start).count());
+	}
+	allocations = ntAllocationCount.load() - allocations;
+	bytes = ntAllocationBytes.load() - bytes;
+
+	NtBenchmarkResult result;
+	result.name = name;
+	result.kind = kind;
+	result.unit = unit;
+	result.items = items;
+	result.iterations = iterations;
+	std::sort(times.begin(), times.end());
+	result.medianMs = times.size() % 2 ? times[times.size() / 2] : (times[times.size() / 2 - 1] + times[times.size() / 2]) / 2;
+	result.p95Ms = times[std::min(times.size() - 1, (size_t)std::ceil(times.size() * 0.95) - 1)];
+	for (double time : times) result.meanMs += time / times.size();
+	result.minMs = times.front();
+	result.throughput = result.medianMs > 0 ? items / (result.medianMs / 1000.0) : 0;
+	result.allocations = (double)allocations / iterations;
+	result.allocatedBytes = (double)bytes / iterations;
+	suite.results.push_back(result);
+
+	printf("%-40s median %10.3f ms  p95 %10.3f ms  %12.4g %s/s  %10.1f allocs\n", name.c_str(), result.medianMs, result.p95Ms,
+		result.throughput, unit.c_str(), result.allocations);
+}
+
+/// <summary>
+/// Writes a width x height binary PPM of deterministic noise
+/// </summary>
+static int NtWriteNoisePPM(const std::string& path, int width, int height, unsigned int seed = 12345) {
+	std::ofstream file(path, std::ios::binary);
+	if (!file.is_open()) return NT_FAILURE;
+	file << "P6\n" << width << " " << height << "\n255\n";
+	std::vector<unsigned char> pixels((size_t)width * height * 3);
+	unsigned int state = seed;
+	for (unsigned char& value : pixels) {
+		state = state * 1664525u + 1013904223u;
+		value = (unsigned char)(state >> 24);
+	}
+	file.write((const char*)pixels.data(), pixels.size());
+	return file ? NT_SUCCESS : NT_FAILURE;
+}
+
+/// <summary>
+/// Writes a cells x cells grid of triangle pairs as a JSON mesh and as an OBJ, returns the triangle count
+/// </summary>
+static int NtWriteGridMeshes(const std::string& jsonPath, const std::string& objPath, int cells) {
+	std::ofstream jsonFile(jsonPath), objFile(objPath);
+	if (!jsonFile.is_open() || !objFile.is_open()) return 0;
+	auto vertex = [&](int x, int y) {
+		char buffer[160];
+		snprintf(buffer, sizeof(buffer), "{\"v\": [%f, %f, 0], \"n\": [0, 0, -1], \"t\": [%f, %f]}",
+			(float)x / cells - 0.5f, (float)y / cells - 0.5f, (float)x / cells, (float)y / cells);
+		return std::string(buffer);
+	};
+	jsonFile << "{\"data\": [\n";
+	for (int y = 0; y < cells; y++) {
+		for (int x = 0; x < cells; x++) {
+			if (x || y) jsonFile << ",\n";
+			jsonFile << "{\"v0\": " << vertex(x, y) << ", \"v1\": " << vertex(x + 1, y) << ", \"v2\": " << vertex(x + 1, y + 1) << "},\n";
+			jsonFile << "{\"v0\": " << vertex(x, y) << ", \"v1\": " << vertex(x + 1, y + 1) << ", \"v2\": " << vertex(x, y + 1) << "}";
+		}
+	}
+	jsonFile << "\n]}\n";
+
+	objFile << "vn 0 0 -1\n";
+	for (int y = 0; y <= cells; y++) {
+		for (int x = 0; x <= cells; x++) {
+			objFile << "v " << (float)x / cells - 0.5f << " " << (float)y / cells - 0.5f << " 0\nvt " << (float)x / cells << " " << (float)y / cells << "\n";
+		}
+	}
+	for (int y = 0; y < cells; y++) {
+		for (int x = 0; x < cells; x++) {
+			int i0 = y * (cells + 1) + x + 1, i1 = i0 + 1, i2 = i1 + cells + 1, i3 = i0 + cells + 1;
+			objFile << "f " << i0 << "/" << i0 << "/1 " << i1 << "/" << i1 << "/1 " << i2 << "/" << i2 << "/1\n";
+			objFile << "f " << i0 << "/" << i0 << "/1 " << i2 << "/" << i2 << "/1 " << i3 << "/" << i3 << "/1\n";
+		}
+	}
+	return jsonFile && objFile ? cells * cells * 2 : 0;
+}
+
+/// <summary>
+/// Stage level benchmarks on generated inputs, independent of any scene file
+/// </summary>
+static void NtRunMicroBenchmarks(NtBenchmarkSuite& suite) {
+	const int resolution = 1024;
+	const int count = 1 << 20;
+
+	//Screen space triangles with varying depth and uvs
+	std::vector<Vector3> positions(count * 3);
+	std::vector<Vector2> uvs(count * 3);
+	unsigned int state = 777;
+	auto random = [&state]() {
+		state = state * 1664525u + 1013904223u;
+		return (state >> 8) / 16777216.0f;
+	};
+	for (int i = 0; i < count * 3; i++) {
+		positions[i] = Vector3(random() * resolution, random() * resolution, 0.1f + random());
+		uvs[i] = Vector2(random(), random());
+	}
+	NtRunBenchmark(suite, "micro/texture_setup", "micro", count, "triangles", 20, [&]() {
+		NtTextureSetup setup;
+		float sink = 0;
+		for (int i = 0; i < count; i++) {
+			NtSetupTexture(setup, &uvs[i * 3], &positions[i * 3]);
+			sink += setup.oneOverZ.x;
+		}
+		return std::isnan(sink) ? NT_FAILURE : NT_SUCCESS;
+	});
+
+	std::vector<Vector3> normals(count);
+	for (Vector3& normal : normals) {
+		normal = Vector3(random() - 0.5f, random() - 0.5f, -random());
+		normal.normalize();
+	}
+	NtMaterial material;
+	material.surfaceColor = Vector3(1, 0.5f, 0.25f);
+	material.Ka = 0.2f;
+	material.Kd = 0.7f;
+	material.Ks = 0.5f;
+	material.specularExponent = 16;
+	NtLight light, ambient;
+	light.type = NT_LIGHT_DIRECTIONAL;
+	light.direction = Vector3(-0.7f, 0.7f, -0.3f);
+	light.color = Vector3(1, 1, 1);
+	light.intensity = 1;
+	ambient.type = NT_LIGHT_AMBIENT;
+	ambient.color = Vector3(0.2f, 0.2f, 0.2f);
+	ambient.intensity = 1;
+	Vector3 viewDirection(0, 0, -1);
+	NtRunBenchmark(suite, "micro/phong_shade", "micro", count, "fragments", 20, [&]() {
+		Vector3 sum;
+		for (int i = 0; i < count; i++) {
+			sum = sum + NtLightingPhong(material, normals[i], light, viewDirection, ambient);
+		}
+		return std::isnan(sum.x) ? NT_FAILURE : NT_SUCCESS;
+	});
+
+	std::string texturePath = (suite.scratch / "noise.ppm").string();
+	if (NtWriteNoisePPM(texturePath, 1024, 1024) == NT_SUCCESS) {
+		NtTexture texture(texturePath);
+		NtRunBenchmark(suite, "micro/bilinear_lookup", "micro", count, "lookups", 20, [&]() {
+			float sum = 0;
+			for (int i = 0; i < count; i++) {
+				sum += NtTextureLookUp(uvs[i].x, uvs[i].y, texture).r;
+			}
+			return std::isnan(sum) ? NT_FAILURE : NT_SUCCESS;
+		});
+	}
+
+	//Rasterization in screen space: identity camera and world matrices map NDC straight to the display
+	NtDisplay* display = nullptr;
+	NtRender* render = nullptr;
+	if (NtNewDisplay(&display, resolution, resolution, { 0, 0, 0, 255 }, 0) == NT_SUCCESS && NtNewRender(&render, display) == NT_SUCCESS) {
+		NtCamera camera;
+		NtLoadIdentityMatrix(camera.viewMatrix);
+		NtLoadIdentityMatrix(camera.projectMatrix);
+		camera.viewDirection = viewDirection;
+		NtMatrix identity;
+		NtLoadIdentityMatrix(identity);
+		NtSetWorldMatrix(render, identity, identity);
+		NtPutCamera(render, camera);
+		render->directionalLight = light;
+		render->ambientLight = ambient;
+		NtSetDepthTest(render, false); //Every iteration rasterizes every pixel without clearing depth
+
+		const NT_SHADING_MODE modes[] = { NT_SHADE_FLAT, NT_SHADE_GOURAUD, NT_SHADE_PHONG };
+		const char* modeNames[] = { "flat", "gouraud", "phong" };
+		for (int mode = 0; mode < 3; mode++) {
+			NtSetShadingMode(render, modes[mode]);
+			NtRunBenchmark(suite, std::string("micro/rasterize_") + modeNames[mode], "micro", (double)resolution * resolution, "pixels", 20, [&]() {
+				Vector3 vertices[2][3] = { { { -1, -1, 0.5f }, { 1, -1, 0.5f }, { 1, 1, 0.5f } }, { { -1, -1, 0.5f }, { 1, 1, 0.5f }, { -1, 1, 0.5f } } };
+				Vector3 triangleNormals[3] = { { 0, 0, -1 }, { 0.3f, 0, -1 }, { 0, 0.3f, -1 } };
+				Vector2 triangleUVs[3] = { { 0, 0 }, { 1, 0 }, { 1, 1 } };
+				int status = NT_SUCCESS;
+				for (int i = 0; i < 2; i++) {
+					Vector3 normalList[3] = { triangleNormals[0], triangleNormals[1], triangleNormals[2] };
+					status |= NtPutTriangle(render, vertices[i], normalList, triangleUVs, material);
+				}
+				return status ? NT_FAILURE : NT_SUCCESS;
+			});
+		}
+
+		//Per triangle setup through the real entry point: transform, viewport mapping, clipping, bounding box and edge
+		//functions. The triangles span a third of a pixel so rasterizing them costs at most a pixel or two each.
+		const int setupCount = 1 << 18;
+		const float pixel = 2.0f / resolution;
+		std::vector<Vector3> setupVertices(setupCount * 3);
+		for (int i = 0; i < setupCount; i++) {
+			Vector3 origin(random() * 2 - 1, random() * 2 - 1, 0.1f + random() * 0.8f);
+			setupVertices[i * 3] = origin;
+			setupVertices[i * 3 + 1] = origin + Vector3(pixel / 3, 0, 0);
+			setupVertices[i * 3 + 2] = origin + Vector3(0, pixel / 3, 0);
+		}
+		NtSetShadingMode(render, NT_SHADE_FLAT);
+		NtRunBenchmark(suite, "micro/triangle_setup", "micro", setupCount, "triangles", 20, [&]() {
+			Vector2 triangleUVs[3] = { { 0, 0 }, { 1, 0 }, { 0, 1 } };
+			int status = NT_SUCCESS;
+			for (int i = 0; i < setupCount; i++) {
+				Vector3 vertexList[3] = { setupVertices[i * 3], setupVertices[i * 3 + 1], setupVertices[i * 3 + 2] };
+				Vector3 normalList[3] = { { 0, 0, -1 }, { 0, 0, -1 }, { 0, 0, -1 } };
+				status |= NtPutTriangle(render, vertexList, normalList, triangleUVs, material);
+			}
+			return status ? NT_FAILURE : NT_SUCCESS;
+		});
+	}
+	NtFreeRender(render);
+	NtFreeDisplay(display);
+
+	//Resolve and encode a 1024x1024 display with the default six samples
+	display = nullptr;
+	if (NtNewDisplay(&display, resolution, resolution) == NT_SUCCESS) {
+		NtRunBenchmark(suite, "micro/resolve_6x", "micro", (double)resolution * resolution, "pixels", 20, [&]() {
+			return NtAverageSampleToFrameBuffer(display);
+		});
+
+		std::string encodePath = (suite.scratch / "encode.ppm").string();
+		NtRunBenchmark(suite, "micro/encode_ppm", "micro", (double)resolution * resolution, "pixels", 10, [&]() {
+			FILE* outfile = NULL;
+			if (fopen_s(&outfile, encodePath.c_str(), "wb") != 0 || outfile == NULL) return NT_FAILURE;
+			int status = NtFlushDisplayBufferPPM(outfile, display);
+			fclose(outfile);
+			return status;
+		});
+	}
+	NtFreeDisplay(display);
+
+	std::string jsonMeshPath = (suite.scratch / "grid.json").string();
+	std::string objMeshPath = (suite.scratch / "grid.obj").string();
+	int triangleCount = NtWriteGridMeshes(jsonMeshPath, objMeshPath, 128);
+	if (triangleCount > 0) {
+		const std::pair<std::string, std::string> meshes[] = { { "json", jsonMeshPath }, { "obj", objMeshPath } };
+		for (const auto& [format, path] : meshes) {
+			NtRunBenchmark(suite, "micro/mesh_parse_" + format, "micro", triangleCount, "triangles", 10, [&]() {
+				NtMesh* mesh = nullptr;
+				int status = NtReadMeshFile(path, &mesh);
+				delete mesh;
+				return status;
+			});
+		}
+	}
+}
+
+/// <summary>
+/// Whole frame renders of the benchmark scene, meshes and textures are loaded once before timing
+/// </summary>
+static void NtRunMacroBenchmarks(NtBenchmarkSuite& suite) {
+	NtScene* scene = new NtScene();
+	if (NtLoadSceneJSON(suite.options.scenePath, scene) != NT_SUCCESS) {
+		NtLog(std::cerr, "Benchmark scene " + suite.options.scenePath + " could not be loaded, skipping macro benchmarks\n");
+		NtFreeScene(scene);
+		return;
+	}
+	NtRenderContext* context = nullptr;
+	NtNewRenderContext(&context);
+	context->fastClear = suite.options.fastClear;
+
+	const int resolutions[][2] = { { 512, 512 }, { 1920, 1080 }, { 3840, 2160 } };
+	const NT_SHADING_MODE modes[] = { NT_SHADE_FLAT, NT_SHADE_GOURAUD, NT_SHADE_PHONG };
+	const char* modeNames[] = { "flat", "gouraud", "phong" };
+	for (const auto& resolution : resolutions) {
+		if (suite.options.quick && resolution[0] > 1920) continue;
+		for (int mode = 0; mode < 3; mode++) {
+			for (int aa = 0; aa < 2; aa++) {
+				scene->camera.xRes = resolution[0];
+				scene->camera.yRes = resolution[1];
+				scene->aaSettings = NtAASettings();
+				if (aa) {
+					scene->aaSettings.sampleCount = 4;
+					scene->aaSettings.pattern = NT_AA_PATTERN_ROTATED_GRID;
+				}
+				else {
+					scene->aaSettings.sampleCount = 0;
+				}
+				std::string name = "macro/" + std::filesystem::path(suite.options.scenePath).stem().string() + "_" + std::to_string(resolution[0]) + "x" +
+					std::to_string(resolution[1]) + "_" + modeNames[mode] + (aa ? "_aa4" : "_noaa") +
+					(suite.options.fastClear ? "_fastclear" : "");
+				NtRunBenchmark(suite, name, "macro", (double)resolution[0] * resolution[1], "pixels", resolution[0] > 1920 ? 3 : 7, [&]() {
+					return NtRenderScene(context, scene, "", modes[mode]);
+				});
+			}
+		}
+	}
+	NtFreeRenderContext(context);
+	NtFreeScene(scene);
+}
+
+//Stress scene generation. Every workload is a pure function of its settings and seed, so a scene can be rebuilt
+//anywhere instead of being checked in. Scenes reference their meshes and textures by file name, render them with
+//the output directory as working directory.
+typedef struct NtStressSettings {
+	std::string workload; //grid, dense, large, overdraw or textured
+	std::string directory = ".";
+	std::string mesh; //Geometry id instanced by grid and textured instead of the generated sphere, e.g. teapot5
+	unsigned int seed = 1;
+	int count = 0; //Workload specific, 0 = default: instances, triangles, triangles, layers, textured shapes
+	int xRes = 512;
+	int yRes = 512;
+	int detail = 32; //Sphere slices and stacks for instanced meshes
+	int textureSize = 1024;
+	bool instanced = false; //Grid and textured: one shape listing every pose as an instance instead of a shape per pose
+} NtStressSettings;
+
+//Linear congruential generator, unlike the standard distributions it gives the same sequence on every platform
+typedef struct NtStressRandom {
+	unsigned int state;
+	float Next() {
+		state = state * 1664525u + 1013904223u;
+		return (state >> 8) / 16777216.0f;
+	}
+	float Range(float low, float high) { return low + (high - low) * Next(); }
+} NtStressRandom;
+
+typedef struct NtStressVertex {
+	float position[3];
+	float normal[3];
+	float uv[2];
+} NtStressVertex;
+
+/// <summary>
+/// Writes an indexed triangle mesh as binary little endian PLY
+/// </summary>
+static int NtWriteStressMesh(const std::string& path, const std::vector<NtStressVertex>& vertices, const std::vector<int>& indices) {
+	std::ofstream file(path, std::ios::binary);
+	if (!file.is_open()) return NT_FAILURE;
+	file << "ply\nformat binary_little_endian 1.0\ncomment NocturneGL stress scene\n";
+	file << "element vertex " << vertices.size() << "\nproperty float x\nproperty float y\nproperty float z\n";
+	file << "property float nx\nproperty float ny\nproperty float nz\nproperty float u\nproperty float v\n";
+	file << "element face " << indices.size() / 3 << "\nproperty list uchar int vertex_indices\nend_header\n";
+	file.write((const char*)vertices.data(), vertices.size() * sizeof(NtStressVertex));
+	std::vector<char> faces(indices.size() / 3 * 13);
+	for (size_t face = 0; face < indices.size() / 3; face++) {
+		faces[face * 13] = 3;
+		std::memcpy(&faces[face * 13 + 1], &indices[face * 3], 12);
+	}
+	file.write(faces.data(), faces.size());
+	return file ? NT_SUCCESS : NT_FAILURE;
+}
+
+/// <summary>
+/// Unit sphere with slices x stacks quads
+/// </summary>
+static int NtWriteStressSphere(const std::string& path, int slices, int stacks) {
+	const float pi = 3.14159265358979f;
+	std::vector<NtStressVertex> vertices;
+	std::vector<int> indices;
+	for (int stack = 0; stack <= stacks; stack++) {
+		float phi = pi * stack / stacks;
+		for (int slice = 0; slice <= slices; slice++) {
+			float theta = 2 * pi * slice / slices;
+			float n[3] = { std::sin(phi) * std::cos(theta), std::cos(phi), std::sin(phi) * std::sin(theta) };
+			vertices.push_back({ { n[0], n[1], n[2] }, { n[0], n[1], n[2] }, { (float)slice / slices, (float)stack / stacks } });
+		}
+	}
+	for (int stack = 0; stack < stacks; stack++) {
+		for (int slice = 0; slice < slices; slice++) {
+			int i0 = stack * (slices + 1) + slice, i1 = i0 + 1, i2 = i0 + slices + 1, i3 = i2 + 1;
+			if (stack > 0) indices.insert(indices.end(), { i0, i1, i2 });
+			if (stack < stacks - 1) indices.insert(indices.end(), { i1, i3, i2 });
+		}
+	}
+	return NtWriteStressMesh(path, vertices, indices);
+}
+
+/// <summary>
+/// Rippled square of side size in the xy plane split into at least triangleCount triangles
+/// </summary>
+static int NtWriteStressGrid(const std::string& path, int triangleCount, float size, NtStressRandom& random) {
+	int cells = std::max(1, (int)std::ceil(std::sqrt(triangleCount / 2.0)));
+	float frequency = random.Range(2, 6), amplitude = size * 0.02f;
+	std::vector<NtStressVertex> vertices;
+	std::vector<int> indices;
+	vertices.reserve((size_t)(cells + 1) * (cells + 1));
+	indices.reserve((size_t)cells * cells * 6);
+	for (int y = 0; y <= cells; y++) {
+		for (int x = 0; x <= cells; x++) {
+			float u = (float)x / cells, v = (float)y / cells;
+			float z = amplitude * std::sin(frequency * 6.2831853f * u) * std::cos(frequency * 6.2831853f * v);
+			vertices.push_back({ { (u - 0.5f) * size, (v - 0.5f) * size, z }, { 0, 0, 1 }, { u, v } });
+		}
+	}
+	for (int y = 0; y < cells; y++) {
+		for (int x = 0; x < cells; x++) {
+			int i0 = y * (cells + 1) + x, i1 = i0 + 1, i2 = i0 + cells + 1, i3 = i2 + 1;
+			indices.insert(indices.end(), { i0, i1, i3, i0, i3, i2 });
+		}
+	}
+	return NtWriteStressMesh(path, vertices, indices);
+}
+
+/// <summary>
+/// Appends a shape to a scene's shape array
+/// </summary>
+static void NtAddStressShape(json& shapes, const std::string& id, const std::string& geometry, const std::string& texture, NtStressRandom& random,
+	const Vector3& rotation, float scale, const Vector3& translation) {
+	json material = { { "Cs", { random.Range(0.2f, 1), random.Range(0.2f, 1), random.Range(0.2f, 1) } },
+		{ "Ka", 0.3 }, { "Kd", 0.7 }, { "Ks", 0.5 }, { "Kt", 0.7 }, { "n", 8.0 } };
+	if (!texture.empty()) material["texture"] = texture;
+	shapes.push_back({ { "id", id }, { "notes", "" }, { "geometry", geometry }, { "material", material },
+		{ "transforms", { { { "Rx", rotation.x }, { "Ry", rotation.y }, { "Rz", rotation.z } }, { { "S", { scale, scale, scale } } },
+			{ { "T", { translation.x, translation.y, translation.z } } } } } });
+}
+
+/// <summary>
+/// Writes the scene JSON, its meshes and textures for one workload into settings.directory
+/// </summary>
+static int NtGenerateStressScene(const NtStressSettings& settings) {
+	std::error_code error;
+	std::filesystem::create_directories(settings.directory, error);
+	std::filesystem::path directory(settings.directory);
+	NtStressRandom random = { settings.seed * 2654435761u + 1 };
+
+	//Camera on +z looking at the origin, the view at the origin plane spans about +-3.3 units vertically
+	const float distance = 10, near = 3, far = 30;
+	float aspect = (float)settings.xRes / settings.yRes;
+	float halfHeight = distance / near, halfWidth = halfHeight * aspect;
+	json scene;
+	scene["camera"] = { { "from", { 0, 0, distance } }, { "to", { 0, 0, 0 } }, { "bounds", { near, far, aspect, -aspect, 1, -1 } },
+		{ "resolution", { settings.xRes, settings.yRes } } };
+	scene["lights"] = { { { "id", "ambient" }, { "type", "ambient" }, { "color", { 1, 1, 1 } }, { "intensity", 0.2 } },
+		{ { "id", "key" }, { "type", "directional" }, { "color", { 1, 1, 1 } }, { "intensity", 0.8 }, { "from", { 5, 8, 10 } }, { "to", { 0, 0, 0 } } } };
+	json& shapes = scene["shapes"] = json::array();
+	size_t triangles = 0;
+	int textures = 0;
+	int status = NT_SUCCESS;
+
+	if (settings.workload == "grid" || settings.workload == "textured") {
+		//Instances of one sphere on a square grid filling the view, each with its own pose
+		bool textured = settings.workload == "textured";
+		int count = settings.count > 0 ? settings.count : textured ? 16 : 100;
+		int columns = (int)std::ceil(std::sqrt((double)count));
+		float spacing = 2 * halfHeight / columns;
+		std::string geometry = "sphere.ply";
+		size_t meshTriangles = (size_t)2 * settings.detail * (settings.detail - 1);
+		float meshScale = 1;
+		if (settings.mesh.empty()) {
+			status |= NtWriteStressSphere((directory / geometry).string(), settings.detail, settings.detail);
+		}
+		else {
+			//Copied next to the scene and scaled to the unit sphere the generated mesh would fill
+			geometry = settings.mesh;
+			std::string meshPath = NtResolveMeshPath(geometry);
+			NtMesh* mesh = nullptr;
+			if (NtReadMeshFile(meshPath, &mesh) != NT_SUCCESS) return NT_FAILURE;
+			float radius = 0;
+			for (const NtTriangle& triangle : mesh->triangles) {
+				for (const NtVertex* vertex : { &triangle.v0, &triangle.v1, &triangle.v2 }) {
+					radius = std::max(radius, std::sqrt(vertex->vertexPos.x * vertex->vertexPos.x +
+						vertex->vertexPos.y * vertex->vertexPos.y + vertex->vertexPos.z * vertex->vertexPos.z));
+				}
+			}
+			meshTriangles = mesh->triangles.size();
+			meshScale = radius > 0 ? 1 / radius : 1;
+			delete mesh;
+			std::filesystem::copy_file(meshPath, directory / std::filesystem::path(meshPath).filename(),
+				std::filesystem::copy_options::overwrite_existing, error);
+			if (error) status = NT_FAILURE;
+		}
+		for (int i = 0; i < count; i++) {
+			std::string texture;
+			if (textured) {
+				texture = "texture" + std::to_string(i) + ".ppm";
+				status |= NtWriteNoisePPM((directory / texture).string(), settings.textureSize, settings.textureSize, random.state + i);
+				textures++;
+			}
+			Vector3 position((i % columns + 0.5f) * spacing - halfHeight, (i / columns + 0.5f) * spacing - halfHeight, random.Range(-1, 1));
+			Vector3 rotation(random.Range(0, 360), random.Range(0, 360), random.Range(0, 360));
+			NtAddStressShape(shapes, "instance" + std::to_string(i), geometry, texture, random, rotation, spacing * 0.45f * meshScale, position);
+			triangles += meshTriangles;
+		}
+		if (settings.instanced && !shapes.empty()) {
+			//Same poses and materials folded into one instanced shape, renders like the separate shapes
+			json instanced = shapes[0];
+			instanced["id"] = "instances";
+			instanced["transforms"] = { { { "Rx", 0 }, { "Ry", 0 }, { "Rz", 0 } }, { { "S", { 1, 1, 1 } } }, { { "T", { 0, 0, 0 } } } };
+			instanced["instances"] = json::array();
+			for (const json& shape : shapes) {
+				instanced["instances"].push_back({ { "transforms", shape["transforms"] }, { "material", shape["material"] } });
+			}
+			shapes = json::array({ instanced });
+		}
+	}
+	else if (settings.workload == "dense") {
+		//One mesh of tiny triangles spanning the view
+		int count = settings.count > 0 ? settings.count : 1000000;
+		status |= NtWriteStressGrid((directory / "dense.ply").string(), count, 2 * halfWidth, random);
+		NtAddStressShape(shapes, "dense", "dense.ply", "", random, Vector3(0, 0, 0), 1, Vector3(0, 0, 0));
+		int cells = std::max(1, (int)std::ceil(std::sqrt(count / 2.0)));
+		triangles = (size_t)cells * cells * 2;
+	}
+	else if (settings.workload == "large" || settings.workload == "overdraw") {
+		//Large: a few triangles reaching far past the screen edges in random order and orientation.
+		//Overdraw: screen covering quads stacked back to front so every layer passes the depth test.
+		bool large = settings.workload == "large";
+		int count = settings.count > 0 ? settings.count : large ? 8 : 32;
+		float side = large ? 40 * halfWidth : 2.2f * halfWidth * (distance + 2) / distance;
+		status |= NtWriteStressGrid((directory / "quad.ply").string(), 2, 1, random);
+		for (int i = 0; i < count; i++) {
+			float depth = large ? random.Range(-2, 2) : -2 + 4.0f * i / std::max(1, count - 1);
+			Vector3 rotation(0, 0, large ? random.Range(0, 360) : 0);
+			NtAddStressShape(shapes, "layer" + std::to_string(i), "quad.ply", "", random, rotation, side, Vector3(0, 0, depth));
+			triangles += 2;
+		}
+	}
+	else {
+		NtLog(std::cerr, "Unknown stress workload " + settings.workload + ", expected grid, dense, large, overdraw or textured\n");
+		return NT_FAILURE;
+	}
+
+	//Settings are recorded beside the scene so results can be charted against them, the scene parser ignores them
+	json output;
+	output["scene"] = scene;
+	output["generator"] = { { "workload", settings.workload }, { "seed", settings.seed }, { "count", settings.count }, { "mesh", settings.mesh },
+		{ "instanced", settings.instanced }, { "resolution", { settings.xRes, settings.yRes } }, { "triangles", triangles }, { "shapes", shapes.size() }, { "textures", textures } };
+	std::string scenePath = (directory / (settings.workload + ".json")).string();
+	std::ofstream file(scenePath);
+	if (!file.is_open()) {
+		NtLog(std::cerr, "Failed to write " + scenePath + "\n");
+		return NT_FAILURE;
+	}
+	file << output.dump(2) << "\n";
+	if (status != NT_SUCCESS) {
+		NtLog(std::cerr, "Failed to write the assets of " + scenePath + "\n");
+		return NT_FAILURE;
+	}
+	std::cout << "Wrote " << scenePath << ": " << triangles << " triangles, " << shapes.size() << " shapes, " << textures << " textures\n";
+	return NT_SUCCESS;
+}
+
+/// <summary>
+/// Writes the suite results as JSON
+/// </summary>
+static int NtWriteBenchmarkJSON(const NtBenchmarkSuite& suite) {
+	json output;
+	output["suite"] = "NocturneGL";
+	output["timestamp"] = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	output["threads"] = std::thread::hardware_concurrency();
+	output["quick"] = suite.options.quick;
+	output["scene"] = suite.options.scenePath;
+	output["fast_clear"] = suite.options.fastClear;
+	output["benchmarks"] = json::array();
+	for (const NtBenchmarkResult& result : suite.results) {
+		output["benchmarks"].push_back({
+			{ "name", result.name }, { "kind", result.kind }, { "iterations", result.iterations },
+			{ "items", result.items }, { "unit", result.unit },
+			{ "median_ms", result.medianMs }, { "p95_ms", result.p95Ms }, { "mean_ms", result.meanMs }, { "min_ms", result.minMs },
+			{ "throughput_per_s", result.throughput },
+			{ "allocations", result.allocations }, { "allocated_bytes", result.allocatedBytes } });
+	}
+	std::ofstream file(suite.options.outputPath);
+	if (!file.is_open()) {
+		NtLog(std::cerr, "Failed to write benchmark results to " + suite.options.outputPath + "\n");
+		return NT_FAILURE;
+	}
+	file << output.dump(2) << "\n";
+	return NT_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+	NtBenchmarkSuite suite;
+	NtStressSettings stress;
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (argument == "--generate" && hasValue) stress.workload = argv[++i];
+		else if (argument == "--directory" && hasValue) stress.directory = argv[++i];
+		else if (argument == "--mesh" && hasValue) stress.mesh = argv[++i];
+		else if (argument == "--seed" && hasValue) stress.seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+		else if (argument == "--count" && hasValue) stress.count = atoi(argv[++i]);
+		else if (argument == "--detail" && hasValue) stress.detail = std::max(3, atoi(argv[++i]));
+		else if (argument == "--texture-size" && hasValue) stress.textureSize = std::max(1, atoi(argv[++i]));
+		else if (argument == "--instanced") stress.instanced = true;
+		else if (argument == "--resolution" && hasValue && sscanf(argv[i + 1], "%dx%d", &stress.xRes, &stress.yRes) == 2) i++;
+		else if (argument == "--output" && hasValue) suite.options.outputPath = argv[++i];
+		else if (argument == "--filter" && hasValue) suite.options.filter = argv[++i];
+		else if (argument == "--scene" && hasValue) suite.options.scenePath = argv[++i];
+		else if (argument == "--iterations" && hasValue) suite.options.iterations = std::max(1, atoi(argv[++i]));
+		else if (argument == "--quick") suite.options.quick = true;
+		else if (argument == "--fast-clear") suite.options.fastClear = true;
+		else {
+			std::cerr << "Usage: NocturneGLBenchmark [--output benchmark.json] [--filter text] [--iterations n] [--scene scene5.json] [--quick] [--fast-clear]\n"
+				"       NocturneGLBenchmark --generate grid|dense|large|overdraw|textured [--directory dir] [--seed n] [--count n]\n"
+				"                           [--resolution WxH] [--detail n] [--texture-size n] [--mesh geometryId] [--instanced]\n";
+			return 1;
+		}
+	}
+	if (!stress.workload.empty()) {
+		return NtGenerateStressScene(stress) == NT_SUCCESS ? 0 : 1;
+	}
+
+	std::error_code error;
+	suite.scratch = std::filesystem::temp_directory_path(error) / "nocturnegl_benchmark";
+	std::filesystem::create_directories(suite.scratch, error);
+
+	NtRunMicroBenchmarks(suite);
+	NtRunMacroBenchmarks(suite);
+
+	std::filesystem::remove_all(suite.scratch, error);
+	if (NtWriteBenchmarkJSON(suite) != NT_SUCCESS) return 1;
+	std::cout << suite.results.size() << " benchmarks written to " << suite.options.outputPath << "\n";
+	return 0;
+}
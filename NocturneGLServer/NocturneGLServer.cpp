@@ -0,0 +1,432 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#undef near //minwindef.h macros collide with NtCamera fields
+#undef far
+#define NT_SERVER_DEFAULT_ENDPOINT "\\\\.\\pipe\\nocturnegl"
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define NT_SERVER_DEFAULT_ENDPOINT "/tmp/nocturnegl.sock"
+#endif
+#include "../NocturneGL/NocturneGL.h"
+#include "../NocturneGL/externalPlugins/json.hpp"
+#include <iostream>
+#include <chrono>
+#include <filesystem>
+
+/*
+ * Persistent render server. Scene descriptions are parsed once and kept until the file on disk changes, meshes and
+ * textures stay resident in the library's asset cache between jobs, so only the first job pays the load cost. Jobs are newline delimited JSON objects sent over a local Unix socket
+ * (POSIX) or named pipe (Windows), one JSON response line is written back per job:
+ *
+ *   {"scene": "scene5.json", "output": "out.ppm", "shading": "phong", "resolution": [512, 512],
+ *    "camera": {"from": [0, 0, -5], "to": [0, 0, 0]}, "time": 0, "antialiasing": {"samples": 4}}
+ *
+ * Only "scene" and "output" are required. Successful responses carry the frame's NtRenderStats as "renderStats", and
+ * "trace": "job.trace.json" records the job as a Chrome trace (see NtBeginTrace). "view": "overdraw", "depthRejects"
+ * or "tileCost" writes that heatmap instead of the image and reports the value at the top of its ramp as "heatmapMaximum".
+ * {"command": "stats"} reports cache counters and {"command": "shutdown"}
+ * stops the server. Connections are served in arrival order and jobs within a connection run in the order sent.
+ * Scene, mesh and texture paths resolve against the server's working directory, as they do for the demo applications.
+ */
+
+using json = nlohmann::json;
+
+//Cached asset with the modification time of the file it was read from
+template <typename T>
+struct NtCacheEntry {
+	std::filesystem::file_time_type modifiedTime;
+	T* asset = nullptr;
+};
+
+typedef struct NtServerState {
+	std::unordered_map<std::string, NtCacheEntry<NtScene>> scenes; //Parsed scene descriptions, meshes and textures live in the shared asset cache
+	NtRenderContext* context = nullptr; //Frame buffers survive across jobs of the same resolution
+	int jobCount = 0;
+	int cacheHits = 0;
+	int cacheMisses = 0;
+	bool running = true;
+} NtServerState;
+
+/// <summary>
+/// Returns the cached asset for path, reloading it with load when missing or when the file changed since it was cached
+/// </summary>
+/// <param name="state"></param>
+/// <param name="cache"></param>
+/// <param name="path"></param>
+/// <param name="load">Returns a new asset or nullptr on failure</param>
+/// <returns></returns>
+template <typename T, typename Loader>
+static T* NtCacheFetch(NtServerState& state, std::unordered_map<std::string, NtCacheEntry<T>>& cache, const std::string& path, Loader load) {
+	std::error_code error;
+	std::filesystem::file_time_type modifiedTime = std::filesystem::last_write_time(path, error);
+	if (error) {
+		NtLog(std::cerr, "Server could not stat " + path + "\n");
+		return nullptr;
+	}
+
+	auto it = cache.find(path);
+	if (it != cache.end() && it->second.modifiedTime == modifiedTime) {
+		state.cacheHits++;
+		return it->second.asset;
+	}
+
+	state.cacheMisses++;
+	T* asset = load(path);
+	if (nullptr == asset) {
+		return nullptr;
+	}
+	if (it != cache.end()) {
+		//Jobs run one at a time, nothing else can still reference the stale copy
+		delete it->second.asset;
+	}
+	cache[path] = { modifiedTime, asset };
+	return asset;
+}
+
+static NtScene* NtServerLoadScene(const std::string& path) {
+	NtScene* scene = new NtScene();
+	if (NtLoadSceneJSON(path, scene, false) != NT_SUCCESS) {
+		delete scene;
+		return nullptr;
+	}
+	return scene;
+}
+
+static Vector3 NtJsonVector3(const json& value) {
+	return Vector3(value[0], value[1], value[2]);
+}
+
+/// <summary>
+/// Acquires the scene's assets into its maps, applies the job's overrides and renders it
+/// </summary>
+/// <param name="state"></param>
+/// <param name="job"></param>
+/// <param name="scene">Per job copy of a cached description, the caller releases whatever was acquired into its maps</param>
+/// <param name="outputName"></param>
+/// <returns></returns>
+static json NtServerRenderJob(NtServerState& state, const json& job, NtScene& scene, const std::string& outputName) {
+	auto bindTexture = [&scene](NtMaterial& material) {
+		if (material.textureId.empty()) return true;
+		auto textureIt = scene.textureMap.find(material.textureId);
+		if (textureIt == scene.textureMap.end()) {
+			NtTexture* texture = nullptr;
+			if (NtAcquireTexture(material.textureId, &texture) != NT_SUCCESS) return false;
+			textureIt = scene.textureMap.emplace(material.textureId, texture).first;
+		}
+		material.texture = textureIt->second;
+		return true;
+	};
+	for (NtShape& shape : scene.shapes) {
+		if (!shape.geometryId.empty() && scene.meshMap.find(shape.geometryId) == scene.meshMap.end()) {
+			NtMesh* mesh = nullptr;
+			if (NtAcquireMesh(NtResolveMeshPath(shape.geometryId), &mesh) != NT_SUCCESS) {
+				return { { "status", "error" }, { "message", "failed to load mesh " + shape.geometryId } };
+			}
+			scene.meshMap[shape.geometryId] = mesh;
+		}
+
+		if (!bindTexture(shape.material)) {
+			return { { "status", "error" }, { "message", "failed to load texture " + shape.material.textureId } };
+		}
+		for (NtInstance& instance : shape.instances) {
+			if (!bindTexture(instance.material)) {
+				return { { "status", "error" }, { "message", "failed to load texture " + instance.material.textureId } };
+			}
+		}
+	}
+
+	NT_SHADING_MODE shadingMode = NT_SHADE_FLAT;
+	if (job.find("shading") != job.end()) {
+		std::string shadingStr = job["shading"];
+		if (shadingStr == "flat") shadingMode = NT_SHADE_FLAT;
+		else if (shadingStr == "gouraud") shadingMode = NT_SHADE_GOURAUD;
+		else if (shadingStr == "phong") shadingMode = NT_SHADE_PHONG;
+		else return { { "status", "error" }, { "message", "unknown shading mode " + shadingStr } };
+	}
+	NT_DEBUG_VIEW debugView = NT_VIEW_SHADED;
+	if (job.find("view") != job.end()) {
+		std::string viewStr = job["view"];
+		if (viewStr == "shaded") debugView = NT_VIEW_SHADED;
+		else if (viewStr == "overdraw") debugView = NT_VIEW_OVERDRAW;
+		else if (viewStr == "depthRejects") debugView = NT_VIEW_DEPTH_REJECTS;
+		else if (viewStr == "tileCost") debugView = NT_VIEW_TILE_COST;
+		else return { { "status", "error" }, { "message", "unknown view " + viewStr } };
+	}
+	if (job.find("resolution") != job.end()) {
+		scene.camera.xRes = job["resolution"][0];
+		scene.camera.yRes = job["resolution"][1];
+		if (scene.camera.xRes <= 0 || scene.camera.yRes <= 0) {
+			return { { "status", "error" }, { "message", "invalid resolution" } };
+		}
+	}
+	if (job.find("time") != job.end()) {
+		NtSetSceneTime(&scene, job["time"]);
+	}
+	//Camera override is applied after posing so it wins over camera keyframes
+	if (job.find("camera") != job.end()) {
+		const json& cameraValue = job["camera"];
+		if (cameraValue.find("from") != cameraValue.end()) scene.camera.from = NtJsonVector3(cameraValue["from"]);
+		if (cameraValue.find("to") != cameraValue.end()) scene.camera.to = NtJsonVector3(cameraValue["to"]);
+		if (cameraValue.find("bounds") != cameraValue.end()) {
+			const json& bounds = cameraValue["bounds"];
+			scene.camera.near = bounds[0];
+			scene.camera.far = bounds[1];
+			scene.camera.right = bounds[2];
+			scene.camera.left = bounds[3];
+			scene.camera.top = bounds[4];
+			scene.camera.bottom = bounds[5];
+		}
+	}
+	if (job.find("antialiasing") != job.end()) {
+		if (NtParseAASettingsJSON(job["antialiasing"].dump(), scene.aaSettings) != NT_SUCCESS) {
+			return { { "status", "error" }, { "message", "invalid antialiasing settings" } };
+		}
+	}
+
+	//The context outlives the job, every job sets its own view
+	state.context->debugView = debugView;
+	if (NtRenderScene(state.context, &scene, outputName, shadingMode) != NT_SUCCESS) {
+		return { { "status", "error" }, { "message", "render failed" } };
+	}
+	return { { "status", "ok" } };
+
+}
+
+/// <summary>
+/// Runs one render job against the caches and returns the response object
+/// </summary>
+/// <param name="state"></param>
+/// <param name="job"></param>
+/// <returns></returns>
+static json NtServerRunJob(NtServerState& state, const json& job) {
+	auto start = std::chrono::high_resolution_clock::now();
+	NtAssetCacheStats assetStats = NtGetAssetCacheStats();
+	int hits = state.cacheHits + assetStats.hits;
+	int misses = state.cacheMisses + assetStats.misses;
+
+	if (job.find("scene") == job.end() || job.find("output") == job.end()) {
+		return { { "status", "error" }, { "message", "job requires scene and output" } };
+	}
+	std::string scenePath = job["scene"];
+	std::string outputName = job["output"];
+
+	NtScene* cachedScene = NtCacheFetch(state, state.scenes, scenePath, NtServerLoadScene);
+	if (nullptr == cachedScene) {
+		return { { "status", "error" }, { "message", "failed to load scene " + scenePath } };
+	}
+
+	//Per job copy so overrides never leak into the cached description
+	NtScene scene = *cachedScene;
+	json response;
+	try {
+		response = NtServerRenderJob(state, job, scene, outputName);
+	}
+	catch (const std::exception& e) {
+		response = { { "status", "error" }, { "message", e.what() } };
+	}
+	//World matrices are cached with the description, nodes check their transforms so the next job only rebuilds moved ones
+	cachedScene->nodes = std::move(scene.nodes);
+	//Released assets stay resident until the cache budget evicts them, the next job reacquires without parsing
+	for (auto& mesh : scene.meshMap) NtReleaseMesh(mesh.second);
+	for (auto& texture : scene.textureMap) NtReleaseTexture(texture.second);
+	if (response["status"] != "ok") {
+		return response;
+	}
+
+	state.jobCount++;
+	auto stop = std::chrono::high_resolution_clock::now();
+	assetStats = NtGetAssetCacheStats();
+	json result = {
+		{ "status", "ok" },
+		{ "output", outputName },
+		{ "milliseconds", std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count() },
+		{ "cacheHits", state.cacheHits + assetStats.hits - hits },
+		{ "cacheMisses", state.cacheMisses + assetStats.misses - misses },
+		{ "renderStats", json::parse(NtRenderStatsJSON(state.context->stats)) }
+	};
+	if (state.context->debugView != NT_VIEW_SHADED) result["heatmapMaximum"] = state.context->heatmap.maximum;
+	return result;
+}
+
+/// <summary>
+/// Handles one request line, either a render job or a server command
+/// </summary>
+/// <param name="state"></param>
+/// <param name="line"></param>
+/// <returns>Response line without the trailing newline</returns>
+static std::string NtServerHandleLine(NtServerState& state, const std::string& line) {
+	json request;
+	try {
+		request = json::parse(line);
+	}
+	catch (const std::exception& e) {
+		return json({ { "status", "error" }, { "message", std::string("invalid request ") + e.what() } }).dump();
+	}
+
+	try {
+		if (request.find("command") != request.end()) {
+			std::string command = request["command"];
+			if (command == "shutdown") {
+				state.running = false;
+				return json({ { "status", "ok" } }).dump();
+			}
+			if (command == "stats") {
+				NtAssetCacheStats assetStats = NtGetAssetCacheStats();
+				return json({
+					{ "status", "ok" },
+					{ "jobs", state.jobCount },
+					{ "cacheHits", state.cacheHits + assetStats.hits },
+					{ "cacheMisses", state.cacheMisses + assetStats.misses },
+					{ "scenes", state.scenes.size() },
+					{ "meshes", assetStats.meshCount },
+					{ "textures", assetStats.textureCount },
+					{ "assetBytes", assetStats.residentBytes }
+				}).dump();
+			}
+			return json({ { "status", "error" }, { "message", "unknown command " + command } }).dump();
+		}
+		//Optional Chrome trace of this job alone, from scene fetch to flush
+		std::string tracePath = request.value("trace", "");
+		bool traced = !tracePath.empty() && NtBeginTrace() == NT_SUCCESS;
+		json response = NtServerRunJob(state, request);
+		if (traced && NtEndTrace(tracePath) == NT_SUCCESS) response["trace"] = tracePath;
+		return response.dump();
+	}
+	catch (const std::exception& e) {
+		//Malformed fields must fail the job, not the server
+		return json({ { "status", "error" }, { "message", e.what() } }).dump();
+	}
+}
+
+/// <summary>
+/// Reads request lines from a connected client until it disconnects or a shutdown is requested
+/// </summary>
+/// <param name="state"></param>
+/// <param name="readBytes">Reads up to size bytes, returns the count or 0 once the client is gone</param>
+/// <param name="writeBytes"></param>
+template <typename Reader, typename Writer>
+static void NtServeConnection(NtServerState& state, Reader readBytes, Writer writeBytes) {
+	std::string pending;
+	char buffer[4096];
+	while (state.running) {
+		size_t newline = pending.find('\n');
+		if (newline == std::string::npos) {
+			int count = readBytes(buffer, sizeof(buffer));
+			if (count <= 0) {
+				return;
+			}
+			pending.append(buffer, count);
+			continue;
+		}
+
+		std::string line = pending.substr(0, newline);
+		pending.erase(0, newline + 1);
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		if (line.empty()) {
+			continue;
+		}
+		std::string response = NtServerHandleLine(state, line) + "\n";
+		if (!writeBytes(response.data(), (int)response.size())) {
+			return;
+		}
+	}
+}
+
+#ifdef _WIN32
+static int NtServerListen(NtServerState& state, const std::string& endpoint) {
+	while (state.running) {
+		HANDLE pipe = CreateNamedPipeA(endpoint.c_str(), PIPE_ACCESS_DUPLEX, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
+			PIPE_UNLIMITED_INSTANCES, 65536, 65536, 0, NULL);
+		if (pipe == INVALID_HANDLE_VALUE) {
+			NtLog(std::cerr, "Failed to create named pipe " + endpoint + "\n");
+			return NT_FAILURE;
+		}
+		if (ConnectNamedPipe(pipe, NULL) || GetLastError() == ERROR_PIPE_CONNECTED) {
+			NtServeConnection(state,
+				[pipe](char* data, int size) {
+					DWORD count = 0;
+					return ReadFile(pipe, data, (DWORD)size, &count, NULL) ? (int)count : 0;
+				},
+				[pipe](const char* data, int size) {
+					DWORD count = 0;
+					return WriteFile(pipe, data, (DWORD)size, &count, NULL) && (int)count == size;
+				});
+			FlushFileBuffers(pipe);
+			DisconnectNamedPipe(pipe);
+		}
+		CloseHandle(pipe);
+	}
+	return NT_SUCCESS;
+}
+#else
+static int NtServerListen(NtServerState& state, const std::string& endpoint) {
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (endpoint.size() >= sizeof(address.sun_path)) {
+		NtLog(std::cerr, "Socket path too long " + endpoint + "\n");
+		return NT_FAILURE;
+	}
+	std::copy(endpoint.begin(), endpoint.end(), address.sun_path);
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0) {
+		NtLog(std::cerr, "Failed to create socket\n");
+		return NT_FAILURE;
+	}
+	unlink(endpoint.c_str());
+	if (bind(listener, (sockaddr*)&address, sizeof(address)) < 0 || listen(listener, 16) < 0) {
+		NtLog(std::cerr, "Failed to bind socket " + endpoint + "\n");
+		close(listener);
+		return NT_FAILURE;
+	}
+
+	while (state.running) {
+		int client = accept(listener, NULL, NULL);
+		if (client < 0) {
+			continue;
+		}
+		NtServeConnection(state,
+			[client](char* data, int size) {
+				ssize_t count = recv(client, data, size, 0);
+				return count > 0 ? (int)count : 0;
+			},
+			[client](const char* data, int size) {
+				return send(client, data, size, MSG_NOSIGNAL) == size;
+			});
+		close(client);
+	}
+
+	close(listener);
+	unlink(endpoint.c_str());
+	return NT_SUCCESS;
+}
+#endif
+
+/// <summary>
+/// Usage: NocturneGLServer [endpoint]. The endpoint defaults to a named pipe on Windows and a Unix socket elsewhere.
+/// </summary>
+int main(int argc, char** argv)
+{
+	std::string endpoint = argc > 1 ? argv[1] : NT_SERVER_DEFAULT_ENDPOINT;
+
+	NtServerState state;
+	if (NtNewRenderContext(&state.context) != NT_SUCCESS) {
+		return NT_FAILURE;
+	}
+
+	std::cout << "NocturneGL render server listening on " << endpoint << "\n";
+	int status = NtServerListen(state, endpoint);
+
+	NtFreeRenderContext(state.context);
+	for (auto& entry : state.scenes) delete entry.second.asset;
+	NtTrimAssetCache();
+
+	std::cout << "\nNocturneGL render server served " << state.jobCount << " jobs.\n";
+	return status;
+}
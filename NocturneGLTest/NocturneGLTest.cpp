@@ -0,0 +1,373 @@
+#include "../NocturneGL/NocturneGL.h"
+#include "../NocturneGL/externalPlugins/json.hpp"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+/*
+ * Golden image regression test. Renders the rect fill test, scene.json and scene5.json in every shading mode, plus the
+ * adaptive and FXAA resolves and each AA mode again with fast clears, and compares each frame with the golden images
+ * committed in NocturneGLTest/golden by max error, PSNR and SSIM (NtCompareImages). scene5 phong is also rendered with
+ * its mesh and texture converted to every other format and texture layout the loaders accept, see NtWriteFormatScenes,
+ * and compared with the same golden. Failing cases write <name>.actual.ppm and <name>.diff.ppm beside the golden
+ * image and the test exits non-zero. Run it from the NocturneGL directory, as the demo applications are:
+ *
+ *   NocturneGLTest [--golden dir] [--update] [--max-error f] [--min-psnr dB] [--min-ssim s]
+ *
+ * Tolerances default to NtImageTolerance. --update rewrites the goldens from the current build, only do so for an
+ * intended change in output. Goldens are 8 bit, well inside the default tolerances.
+ *
+ * rects and scene5 phong are also checked against output1.ppm and output6.ppm, the original renderer's committed output,
+ * within NtBaselineTolerance. Sub-pixel sample offsets now reach the rasterizer instead of being truncated to whole pixels,
+ * which moves anti-aliased edges, so that check only catches gross changes from the original renderer.
+ */
+
+using json = nlohmann::json;
+
+typedef struct NtTestSettings {
+	std::string directory = "../NocturneGLTest/golden";
+	bool update = false; //Store new golden images instead of comparing
+	NtImageTolerance tolerance;
+} NtTestSettings;
+
+typedef struct NtGoldenCase {
+	std::string name;
+	std::string scenePath; //Empty = the rects display fill of Application1
+	NT_SHADING_MODE shadingMode = NT_SHADE_FLAT;
+	int aaMode = -1; //NT_AA_MODE override, -1 keeps the scene's settings
+	std::string baselinePath; //Original renderer output to also compare against, empty = none
+	NtImageTolerance baselineTolerance;
+	std::string goldenName; //Golden image compared against, empty = the case name
+	bool fastClear = false; //Render twice through one context with NtRenderContext::fastClear, check the second frame
+	NT_TEXTURE_LAYOUT textureLayout = NT_TEXTURE_LINEAR; //Layout the asset cache decodes the scene's textures in
+
+	NtGoldenCase(const std::string& name, const std::string& scenePath, NT_SHADING_MODE shadingMode, int aaMode = -1,
+		const std::string& goldenName = "") : name(name), scenePath(scenePath), shadingMode(shadingMode), aaMode(aaMode), goldenName(goldenName) {}
+} NtGoldenCase;
+
+//Tolerances against the original renderer, just outside what was measured. rects differs in the one pixel it wrapped
+//onto the next row, by 0.625. scene5 phong is at 31.7 dB PSNR and 0.974 SSIM from the sub-pixel offsets, which move
+//whole edge pixels, so max error can't be bounded there and PSNR and SSIM are the guards. Broken texturing or shading
+//lands far below them.
+static NtImageTolerance NtBaselineTolerance(double maxAbsError) {
+	NtImageTolerance tolerance;
+	tolerance.maxAbsError = maxAbsError;
+	tolerance.minPSNR = 30;
+	tolerance.minSSIM = 0.97;
+	return tolerance;
+}
+
+/// <summary>
+/// Renders one case into an image with the flushed PPM scale
+/// </summary>
+static int NtRenderGoldenCase(const NtGoldenCase& goldenCase, NtImage& image) {
+	int status = NT_SUCCESS;
+	NtDisplay* display = nullptr;
+	NtScene* scene = nullptr;
+	NtRenderContext* context = nullptr;
+	if (goldenCase.scenePath.empty()) {
+		status |= NtNewDisplay(&display, 512, 512);
+		FILE* input = nullptr;
+		if (status != NT_SUCCESS || fopen_s(&input, "rects", "r") != 0 || input == nullptr) {
+			NtFreeDisplay(display);
+			return NT_FAILURE;
+		}
+		int ulx, uly, lrx, lry, r, g, b;
+		while (fscanf_s(input, "%d %d %d %d %d %d %d", &ulx, &uly, &lrx, &lry, &r, &g, &b) == 7) {
+			for (int y = uly; y <= lry; y++) {
+				for (int x = ulx; x <= lrx; x++) {
+					NtPutDisplay(display, x, y, r, g, b, 1);
+				}
+			}
+		}
+		fclose(input);
+	}
+	else {
+		scene = new NtScene();
+		status |= NtSetTextureLayout(goldenCase.textureLayout);
+		status |= NtLoadSceneJSON(goldenCase.scenePath, scene);
+		NtSetTextureLayout(NT_TEXTURE_LINEAR);
+		if (goldenCase.aaMode >= 0) {
+			scene->aaSettings.mode = (NT_AA_MODE)goldenCase.aaMode;
+			scene->aaSettings.pattern = NT_AA_PATTERN_ROTATED_GRID;
+			scene->aaSettings.sampleCount = 4;
+		}
+		status |= NtNewRenderContext(&context);
+		if (status == NT_SUCCESS) {
+			//The second frame starts on the first one's pixels, so every tile it reads must have been cleared lazily
+			context->fastClear = goldenCase.fastClear;
+			for (int frame = 0; frame < (goldenCase.fastClear ? 2 : 1) && status == NT_SUCCESS; frame++) {
+				status |= NtRenderScene(context, scene, "", goldenCase.shadingMode);
+			}
+		}
+		display = context->display;
+	}
+
+	if (status == NT_SUCCESS) {
+		NtResolveFastClear(display);
+		image.width = display->xRes;
+		image.height = display->yRes;
+		image.maxValue = 5333; //Same scale NtFlushDisplayBufferPPM writes
+		image.pixels.assign(display->frameBuffer, display->frameBuffer + image.width * image.height);
+	}
+	if (context != nullptr) NtFreeRenderContext(context);
+	else if (display != nullptr) NtFreeDisplay(display);
+	if (scene != nullptr) NtFreeScene(scene);
+	return status ? NT_FAILURE : NT_SUCCESS;
+}
+
+/// <summary>
+/// Rounds an image to 8 bit samples, the format goldens are stored in
+/// </summary>
+static NtImage NtQuantizeImage8(const NtImage& image) {
+	NtImage quantized = image;
+	quantized.maxValue = 255;
+	for (NtPixel& pixel : quantized.pixels) {
+		unsigned short* channels[3] = { &pixel.r, &pixel.g, &pixel.b };
+		for (unsigned short* channel : channels) {
+			int value = std::min<int>(*channel, image.maxValue);
+			*channel = (unsigned short)((value * 255 + image.maxValue / 2) / image.maxValue);
+		}
+	}
+	return quantized;
+}
+
+/// <summary>
+/// Compares an image with the reference at path and prints one result row
+/// </summary>
+/// <returns>NT_FAILURE when the reference is missing, a different size or outside the tolerance</returns>
+static int NtCheckImage(const std::string& label, const std::string& referencePath, const NtImage& actual,
+	const NtImageTolerance& tolerance, NtImage* diff) {
+	NtImage reference;
+	NtImageDifference difference;
+	if (NtReadImagePPM(referencePath, reference) != NT_SUCCESS || NtCompareImages(reference, actual, difference, diff) != NT_SUCCESS) {
+		std::cout << label << ": no comparable reference image at " << referencePath << "\n";
+		return NT_FAILURE;
+	}
+	bool passed = NtImageWithinTolerance(difference, tolerance);
+	char line[256];
+	snprintf(line, sizeof(line), "%-34s %12.6f %10.2f %10.6f %10d %s\n", label.c_str(), difference.maxAbsError,
+		difference.psnr, difference.ssim, difference.differingPixels, passed ? "ok" : "FAILED");
+	std::cout << line;
+	return passed ? NT_SUCCESS : NT_FAILURE;
+}
+
+//Mesh and texture formats. teapot5 and usc-texture are converted into a scratch directory, each referenced by a copy of
+//scene5.json, so they load through the .asc, OBJ, PLY and .ntx readers and must render as the originals do.
+typedef struct NtFormatScene {
+	const char* name;
+	const char* mesh; //File written for teapot5, nullptr = the original
+	const char* texture; //File written for usc-texture, nullptr = the original
+} NtFormatScene;
+
+/// <summary>
+/// Appends a float in big endian byte order
+/// </summary>
+static void NtAppendBigEndian(std::string& data, const void* value) {
+	const unsigned char* bytes = (const unsigned char*)value;
+	data.append({ (char)bytes[3], (char)bytes[2], (char)bytes[1], (char)bytes[0] });
+}
+
+/// <summary>
+/// Writes a mesh as an unindexed triangle list in the format of the path's extension: .asc, .obj or binary .ply,
+/// little endian unless bigEndian. Text formats print floats with 9 significant digits so they read back exactly.
+/// </summary>
+static int NtWriteMeshFormat(const NtMesh& mesh, const std::string& path, bool bigEndian = false) {
+	std::ofstream file(path, std::ios::binary);
+	if (!file.is_open()) return NT_FAILURE;
+	char line[256];
+	auto isExtension = [&path](const char* extension) { return std::filesystem::path(path).extension() == extension; };
+	if (isExtension(".ply")) {
+		file << "ply\nformat binary_" << (bigEndian ? "big" : "little") << "_endian 1.0\n";
+		file << "element vertex " << mesh.triangles.size() * 3 << "\nproperty float x\nproperty float y\nproperty float z\n";
+		file << "property float nx\nproperty float ny\nproperty float nz\nproperty float u\nproperty float v\n";
+		file << "element face " << mesh.triangles.size() << "\nproperty list uchar int vertex_indices\nend_header\n";
+	}
+	std::string data;
+	int index = 0;
+	for (const NtTriangle& triangle : mesh.triangles) {
+		const NtVertex* vertices[3] = { &triangle.v0, &triangle.v1, &triangle.v2 };
+		if (isExtension(".asc")) data += "triangle\n";
+		for (const NtVertex* vertex : vertices) {
+			const float values[8] = { vertex->vertexPos.x, vertex->vertexPos.y, vertex->vertexPos.z, vertex->vertexNormal.x,
+				vertex->vertexNormal.y, vertex->vertexNormal.z, vertex->texture.x, vertex->texture.y };
+			if (isExtension(".asc")) {
+				snprintf(line, sizeof(line), "%.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n", values[0], values[1], values[2],
+					values[3], values[4], values[5], values[6], values[7]);
+				data += line;
+			}
+			else if (isExtension(".obj")) {
+				snprintf(line, sizeof(line), "v %.9g %.9g %.9g\nvn %.9g %.9g %.9g\nvt %.9g %.9g\n", values[0], values[1],
+					values[2], values[3], values[4], values[5], values[6], values[7]);
+				data += line;
+			}
+			else {
+				for (const float& value : values) {
+					if (bigEndian) NtAppendBigEndian(data, &value);
+					else data.append((const char*)&value, sizeof(value));
+				}
+			}
+		}
+		if (isExtension(".obj")) {
+			snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d\n", index + 1, index + 1, index + 1, index + 2,
+				index + 2, index + 2, index + 3, index + 3, index + 3);
+			data += line;
+		}
+		index += 3;
+	}
+	if (isExtension(".ply")) {
+		for (int i = 0; i < index; i += 3) {
+			data += (char)3;
+			for (int corner = i; corner < i + 3; corner++) {
+				if (bigEndian) NtAppendBigEndian(data, &corner);
+				else data.append((const char*)&corner, sizeof(corner));
+			}
+		}
+	}
+	file.write(data.data(), data.size());
+	return file ? NT_SUCCESS : NT_FAILURE;
+}
+
+/// <summary>
+/// Converts teapot5 and usc-texture into scratch, writes a scene5.json copy per format and adds a scene5 phong case
+/// for each, plus cases decoding the texture tiled and in Morton order. Every case is checked against scene5_phong.
+/// </summary>
+static int NtWriteFormatScenes(const std::filesystem::path& scratch, std::vector<NtGoldenCase>& cases) {
+	NtMesh* mesh = nullptr;
+	if (NtReadMeshFile("teapot5.json", &mesh) != NT_SUCCESS) return NT_FAILURE;
+	int status = NT_SUCCESS;
+	status |= NtWriteMeshFormat(*mesh, (scratch / "teapot5.asc").string());
+	status |= NtWriteMeshFormat(*mesh, (scratch / "teapot5.obj").string());
+	status |= NtWriteMeshFormat(*mesh, (scratch / "teapot5_le.ply").string());
+	status |= NtWriteMeshFormat(*mesh, (scratch / "teapot5_be.ply").string(), true);
+	delete mesh;
+	NtTexture texture("usc-texture");
+	status |= NtWriteTextureContainer(texture, (scratch / "usc-texture.ntx").string());
+
+	std::ifstream input("scene5.json");
+	json scene = json::parse(input, nullptr, false);
+	if (status != NT_SUCCESS || scene.is_discarded()) return NT_FAILURE;
+	const NtFormatScene formats[] = { { "asc", "teapot5.asc", nullptr }, { "obj", "teapot5.obj", nullptr },
+		{ "ply_le", "teapot5_le.ply", nullptr }, { "ply_be", "teapot5_be.ply", nullptr }, { "ntx", nullptr, "usc-texture.ntx" } };
+	for (const NtFormatScene& format : formats) {
+		json copy = scene;
+		for (json& shape : copy["scene"]["shapes"]) {
+			if (format.mesh != nullptr) shape["geometry"] = (scratch / format.mesh).string();
+			if (format.texture != nullptr) shape["material"]["texture"] = (scratch / format.texture).string();
+		}
+		std::string scenePath = (scratch / (std::string("scene5_") + format.name + ".json")).string();
+		std::ofstream output(scenePath);
+		output << copy.dump(2) << "\n";
+		if (!output) return NT_FAILURE;
+		cases.emplace_back(std::string("scene5_phong_") + format.name, scenePath, NT_SHADE_PHONG, -1, "scene5_phong");
+	}
+	cases.emplace_back("scene5_phong_tiled", "scene5.json", NT_SHADE_PHONG, -1, "scene5_phong");
+	cases.back().textureLayout = NT_TEXTURE_TILED;
+	cases.emplace_back("scene5_phong_morton", "scene5.json", NT_SHADE_PHONG, -1, "scene5_phong");
+	cases.back().textureLayout = NT_TEXTURE_MORTON;
+	return NT_SUCCESS;
+}
+
+/// <summary>
+/// Renders every golden case and either stores it or compares it against the committed images
+/// </summary>
+/// <returns>NT_FAILURE when any case failed to render, had no golden image or exceeded the tolerance</returns>
+static int NtRunGoldenImages(const NtTestSettings& settings) {
+	std::vector<NtGoldenCase> cases = { NtGoldenCase("rects", "", NT_SHADE_FLAT) };
+	cases.back().baselinePath = "output1.ppm"; //Application1 fills rects
+	cases.back().baselineTolerance = NtBaselineTolerance(0.63);
+	const char* modeNames[] = { "flat", "phong", "gouraud" };
+	for (const char* scenePath : { "scene.json", "scene5.json" }) {
+		for (NT_SHADING_MODE mode : { NT_SHADE_FLAT, NT_SHADE_GOURAUD, NT_SHADE_PHONG }) {
+			std::string sceneName = std::filesystem::path(scenePath).stem().string();
+			cases.emplace_back(sceneName + "_" + modeNames[mode], scenePath, mode);
+		}
+	}
+	cases.back().baselinePath = "output6.ppm"; //Application6 renders scene5.json with phong shading
+	cases.back().baselineTolerance = NtBaselineTolerance(1); //Max error not checked
+	cases.emplace_back("scene5_phong_adaptive", "scene5.json", NT_SHADE_PHONG, NT_AA_ADAPTIVE);
+	cases.emplace_back("scene5_phong_fxaa", "scene5.json", NT_SHADE_PHONG, NT_AA_FXAA);
+	//Lazy per tile clears in every AA mode must match the eagerly cleared goldens
+	const char* aaNames[] = { "", "_adaptive", "_fxaa" };
+	for (int aaMode : { -1, (int)NT_AA_ADAPTIVE, (int)NT_AA_FXAA }) {
+		std::string goldenName = std::string("scene5_phong") + aaNames[std::max(aaMode, 0)];
+		cases.emplace_back(goldenName + "_fastclear", "scene5.json", NT_SHADE_PHONG, aaMode, goldenName);
+		cases.back().fastClear = true;
+	}
+
+	std::error_code error;
+	std::filesystem::path scratch = std::filesystem::temp_directory_path(error) / "nocturnegl_test";
+	std::filesystem::create_directories(scratch, error);
+	int failures = 0;
+	if (NtWriteFormatScenes(scratch, cases) != NT_SUCCESS) {
+		std::cout << "Could not write the mesh and texture format scenes to " << scratch.string() << "\n";
+		failures++;
+	}
+
+	std::filesystem::create_directories(settings.directory, error);
+	std::filesystem::path directory(settings.directory);
+	int checks = 0;
+	if (!settings.update) {
+		char line[256];
+		snprintf(line, sizeof(line), "%-34s %12s %10s %10s %10s\n", "case", "max error", "PSNR dB", "SSIM", "pixels");
+		std::cout << line;
+	}
+	for (const NtGoldenCase& goldenCase : cases) {
+		std::string goldenName = goldenCase.goldenName.empty() ? goldenCase.name : goldenCase.goldenName;
+		std::string goldenPath = (directory / (goldenName + ".ppm")).string();
+		NtImage actual;
+		if (NtRenderGoldenCase(goldenCase, actual) != NT_SUCCESS) {
+			std::cout << goldenCase.name << ": render failed\n";
+			failures++;
+			continue;
+		}
+		if (settings.update) {
+			if (goldenName != goldenCase.name) continue; //Shares another case's golden
+			if (NtWriteImagePPM(goldenPath, NtQuantizeImage8(actual)) != NT_SUCCESS) failures++;
+			else std::cout << "Stored " << goldenPath << "\n";
+			continue;
+		}
+
+		NtImage diff;
+		checks++;
+		if (NtCheckImage(goldenCase.name, goldenPath, actual, settings.tolerance, &diff) != NT_SUCCESS) {
+			failures++;
+			NtWriteImagePPM((directory / (goldenCase.name + ".actual.ppm")).string(), actual);
+			if (!diff.pixels.empty()) NtWriteImagePPM((directory / (goldenCase.name + ".diff.ppm")).string(), diff);
+		}
+		if (!goldenCase.baselinePath.empty()) {
+			checks++;
+			if (NtCheckImage(goldenCase.name + " vs " + goldenCase.baselinePath, goldenCase.baselinePath, actual,
+				goldenCase.baselineTolerance, nullptr) != NT_SUCCESS) failures++;
+		}
+	}
+	//Mapped .ntx containers must be released before their files can be removed
+	NtTrimAssetCache();
+	std::filesystem::remove_all(scratch, error);
+	if (!settings.update) std::cout << checks - failures << " of " << checks << " image checks passed\n";
+	return failures > 0 ? NT_FAILURE : NT_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+	NtTestSettings settings;
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (argument == "--golden" && hasValue) settings.directory = argv[++i];
+		else if (argument == "--update") settings.update = true;
+		else if (argument == "--max-error" && hasValue) settings.tolerance.maxAbsError = atof(argv[++i]);
+		else if (argument == "--min-psnr" && hasValue) settings.tolerance.minPSNR = atof(argv[++i]);
+		else if (argument == "--min-ssim" && hasValue) settings.tolerance.minSSIM = atof(argv[++i]);
+		else {
+			std::cerr << "Usage: NocturneGLTest [--golden dir] [--update] [--max-error f] [--min-psnr dB] [--min-ssim s]\n";
+			return 1;
+		}
+	}
+	int status = NtRunGoldenImages(settings);
+	NtTrimAssetCache(); //Frees the idle cached meshes and textures, so leak checkers see a clean exit
+	return status == NT_SUCCESS ? 0 : 1;
+}